@@ -0,0 +1,422 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_variant.h"
+
+namespace cora
+{
+namespace reflection
+{
+namespace traits
+{
+    template<typename T, typename = void>
+    struct has_polymorphic_allocator : std::false_type {};
+
+    template<typename T>
+    struct has_polymorphic_allocator<T, std::void_t<typename T::allocator_type>>
+        : std::is_same<typename T::allocator_type, std::pmr::polymorphic_allocator<typename T::allocator_type::value_type>> {};
+
+    template<typename T, typename = void>
+    struct has_try_emplace : std::false_type {};
+
+    template<typename T>
+    struct has_try_emplace<T, std::void_t<decltype(std::declval<T&>().try_emplace(std::declval<typename T::key_type const&>()))>> : std::true_type {};
+
+} // namespace traits
+} // namespace reflection
+
+    // moves every std::pmr container of obj into the given memory resource, at any nesting level:
+    // members of nested reflected types, optional values, variant alternatives,
+    // the elements of sequences and the keys and values of maps, std:: containers included.
+    // Containers that already use it are not recreated, their elements are still visited.
+    // Keys that hold std::pmr containers, other than those a std::pmr map rebinds itself,
+    // are rebound by taking their nodes out of the map and putting them back.
+    template<class T>
+    void reflect_rebind_resource(T &obj, std::pmr::memory_resource *resource);
+
+    namespace detail
+    {
+        template<class T>
+        constexpr bool may_hold_resource();
+
+        template<class T, size_t... I>
+        constexpr bool any_field_may_hold_resource(std::index_sequence<I...>)
+        {
+            return (false || ... || may_hold_resource<cora::reflection::field_t<T, I>>());
+        }
+
+        // whether rebind_resource may have something to do with a T, decides the rebinding of map and set keys
+        template<class T>
+        constexpr bool may_hold_resource()
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (traits::has_polymorphic_allocator<T>::value || traits::is_variant<T>::value)
+                return true;
+            else if constexpr (cora::reflection::is_reflected_v<T>)
+                return any_field_may_hold_resource<T>(std::make_index_sequence<cora::reflection::fields_count_v<T>>());
+            else if constexpr (traits::is_optional<T>::value)
+                return may_hold_resource<typename T::value_type>();
+            else if constexpr (traits::is_map<T>::value)
+                return may_hold_resource<typename T::key_type>() || may_hold_resource<typename T::mapped_type>();
+            else if constexpr (traits::is_container<T>::value)
+                return may_hold_resource<typename T::value_type>();
+            else
+                return false;
+        }
+
+        template<class T, typename = void>
+        struct has_node_type : std::false_type {};
+
+        template<class T>
+        struct has_node_type<T, std::void_t<typename T::node_type, typename T::key_type>> : std::true_type {};
+
+        template<class T>
+        void rebind_resource(T &v, std::pmr::memory_resource *resource);
+
+        // allocator is not propagated on assignment, so the container is recreated in place
+        template<class T>
+        void rebind_container(T &v, std::pmr::memory_resource *resource)
+        {
+            if (v.get_allocator().resource() == resource)
+                return;
+
+            T tmp(std::move(v), typename T::allocator_type(resource));
+            std::destroy_at(&v);
+            ::new (static_cast<void*>(std::addressof(v))) T(std::move(tmp));
+        }
+
+        // keys are const in place: every node is taken out, its key rebound and the node put back
+        template<class T>
+        void rebind_keys(T &v, std::pmr::memory_resource *resource)
+        {
+            std::vector<typename T::node_type> nodes;
+            nodes.reserve(v.size());
+            while (!v.empty())
+                nodes.push_back(v.extract(v.begin()));
+
+            for (auto &node : nodes)
+            {
+                if constexpr (cora::reflection::traits::is_map<T>::value)
+                    rebind_resource(node.key(), resource);
+                else
+                    rebind_resource(node.value(), resource);
+
+                v.insert(std::move(node));
+            }
+        }
+
+        // the elements of a pmr container that are allocator-aware themselves got its resource when it was recreated,
+        // but not those inside them or inside other elements, e.g. reflected types, optionals or std::vector
+        template<class T>
+        void rebind_elements(T &v, std::pmr::memory_resource *resource)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (has_node_type<T>::value)
+            {
+                using key_type = typename T::key_type;
+
+                if constexpr (traits::is_map<T>::value && !std::is_scalar_v<typename T::mapped_type>)
+                {
+                    for (auto &elem : v)
+                        rebind_resource(elem.second, resource);
+                }
+
+                // allocator-aware keys of a pmr container are constructed with its resource
+                constexpr bool keys_rebound = traits::has_polymorphic_allocator<T>::value && traits::has_polymorphic_allocator<key_type>::value;
+                if constexpr (may_hold_resource<key_type>() && !keys_rebound)
+                    rebind_keys(v, resource);
+            }
+            else if constexpr (!std::is_scalar_v<typename T::value_type>
+                && std::is_lvalue_reference_v<decltype(*std::declval<T&>().begin())>)
+            {
+                for (auto &elem : v)
+                    rebind_resource(elem, resource);
+            }
+        }
+
+        template<class T>
+        void rebind_resource(T &v, std::pmr::memory_resource *resource)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect_rebind_resource(v, resource);
+            else if constexpr (traits::is_optional<T>::value)
+            {
+                if (v)
+                    rebind_resource(*v, resource);
+            }
+            else if constexpr (traits::is_variant<T>::value)
+            {
+                if (!v.valueless_by_exception())
+                    std::visit([resource](auto &alternative) { rebind_resource(alternative, resource); }, v);
+            }
+            else if constexpr (traits::is_container<T>::value)
+            {
+                if constexpr (traits::has_polymorphic_allocator<T>::value)
+                    rebind_container(v, resource);
+
+                rebind_elements(v, resource);
+            }
+            else if constexpr (traits::has_polymorphic_allocator<T>::value)
+                rebind_container(v, resource);
+        }
+    } // namespace detail
+
+    template<class T>
+    void reflect_rebind_resource(T &obj, std::pmr::memory_resource *resource)
+    {
+        cora::reflection::for_each_field(obj, [resource](auto &member, auto const &)
+        {
+            detail::rebind_resource(member, resource);
+        });
+    }
+
+    // copies rhs into lhs field by field, reusing what lhs already owns:
+    // string buffers, vector capacities, map nodes with the same keys and the nested objects inside them
+    // newly created elements and optional values get the memory resource of the enclosing std::pmr container,
+    // or the given one outside of them, nested reflected types included
+    struct reflect_assign_processor
+        : cora::reflection::processor2
+    {
+        explicit reflect_assign_processor(std::pmr::memory_resource *resource = nullptr)
+            : resource_(resource)
+        {
+        }
+
+        template<class T>
+        void operator()(T &lhs, T const &rhs, char const * /*name*/, ...)
+        {
+            assign(lhs, rhs);
+        }
+
+        template<class T>
+        void assign(T &lhs, T const &rhs)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect2(*this, lhs, rhs);
+            else if constexpr (traits::is_optional<T>::value)
+            {
+                if (!rhs)
+                {
+                    lhs.reset();
+                    return;
+                }
+
+                if (!lhs)
+                {
+                    lhs.emplace();
+                    rebind_new(*lhs);
+                }
+                assign(*lhs, *rhs);
+            }
+            else if constexpr (traits::is_basic_string<T>::value)
+                lhs.assign(rhs.data(), rhs.size());
+            else if constexpr (traits::is_map<T>::value && traits::has_try_emplace<T>::value)
+                assign_map(lhs, rhs);
+            else if constexpr (traits::is_container<T>::value && traits::has_resize<T>::value)
+            {
+                // copy-assignment of trivial elements reuses the capacity anyway
+                if constexpr (std::is_trivially_copyable_v<typename T::value_type>)
+                    lhs = rhs;
+                else
+                    assign_sequence(lhs, rhs);
+            }
+            else
+                lhs = rhs;
+        }
+
+    private:
+        template<class T>
+        void assign_map(T &lhs, T const &rhs)
+        {
+            resource_scope scope(*this, lhs);
+
+            for (auto it = lhs.begin(); it != lhs.end();)
+            {
+                if (rhs.find(it->first) == rhs.end())
+                    it = lhs.erase(it);
+                else
+                    ++it;
+            }
+
+            for (auto const &elem : rhs)
+            {
+                using key_type = typename T::key_type;
+
+                if constexpr (detail::may_hold_resource<key_type>())
+                {
+                    // a new key is built in the resource before it goes into the map, where it is const
+                    auto it = lhs.find(elem.first);
+                    if (it == lhs.end())
+                    {
+                        key_type key;
+                        rebind_new(key);
+                        assign(key, elem.first);
+                        it = lhs.try_emplace(std::move(key)).first;
+                        rebind_new(it->second);
+                    }
+
+                    assign(it->second, elem.second);
+                }
+                else
+                {
+                    auto res = lhs.try_emplace(elem.first);
+                    if (res.second)
+                        rebind_new(res.first->second);
+
+                    assign(res.first->second, elem.second);
+                }
+            }
+        }
+
+        template<class T>
+        void assign_sequence(T &lhs, T const &rhs)
+        {
+            resource_scope scope(*this, lhs);
+
+            size_t const old_size = lhs.size();
+            lhs.resize(rhs.size());
+
+            size_t i = 0;
+            auto dst = lhs.begin();
+            for (auto src = rhs.begin(); src != rhs.end(); ++src, ++dst, ++i)
+            {
+                if (i >= old_size)
+                    rebind_new(*dst);
+
+                assign(*dst, *src);
+            }
+        }
+
+        // pmr containers pass their resource to the elements only if the elements are allocator-aware,
+        // so new reflected elements and optional values are rebound explicitly while they are still empty
+        template<class T>
+        void rebind_new(T &v)
+        {
+            if (resource_)
+                detail::rebind_resource(v, resource_);
+        }
+
+        struct resource_scope
+        {
+            template<class Container>
+            resource_scope(reflect_assign_processor &proc, Container const &container)
+                : proc_(proc)
+                , saved_(proc.resource_)
+            {
+                if constexpr (cora::reflection::traits::has_polymorphic_allocator<Container>::value)
+                    proc.resource_ = container.get_allocator().resource();
+                else
+                    (void) container;
+            }
+
+            ~resource_scope()
+            {
+                proc_.resource_ = saved_;
+            }
+
+        private:
+            reflect_assign_processor &proc_;
+            std::pmr::memory_resource *saved_;
+        };
+
+        std::pmr::memory_resource *resource_;
+    };
+
+    // swaps field by field; std::pmr members with different resources are exchanged by moving elements,
+    // so that both objects keep their own memory resources
+    struct reflect_swap_processor
+        : cora::reflection::processor2
+    {
+        template<class T>
+        void operator()(T &lhs, T &rhs, char const * /*name*/, ...)
+        {
+            if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect2(*this, lhs, rhs);
+            else if constexpr (cora::reflection::traits::is_optional<T>::value)
+            {
+                if (lhs && rhs)
+                    (*this)(*lhs, *rhs, "value");
+                else
+                    lhs.swap(rhs);
+            }
+            else if constexpr (cora::reflection::traits::has_polymorphic_allocator<T>::value)
+            {
+                if (lhs.get_allocator() == rhs.get_allocator())
+                    lhs.swap(rhs);
+                else
+                {
+                    T tmp(std::move(lhs));
+                    lhs = std::move(rhs);
+                    rhs = std::move(tmp);
+                }
+            }
+            else
+            {
+                using std::swap;
+                swap(lhs, rhs);
+            }
+        }
+    };
+
+    // moves rhs into lhs field by field, lhs keeps the memory resources of its std::pmr members
+    struct reflect_move_processor
+        : cora::reflection::processor2
+    {
+        template<class T>
+        void operator()(T &lhs, T &rhs, char const * /*name*/, ...)
+        {
+            if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect2(*this, lhs, rhs);
+            else
+                lhs = std::move(rhs);
+        }
+    };
+
+    template<class T>
+    void reflect_assign(T &dst, T const &src)
+    {
+        reflect_assign_processor proc;
+        proc.assign(dst, src);
+    }
+
+    // deep copy whose std::pmr containers, at any nesting level, are allocated from the given resource
+    template<class T>
+    T reflect_copy_into(T const &src, std::pmr::memory_resource *resource)
+    {
+        T dst;
+        reflect_rebind_resource(dst, resource);
+
+        reflect_assign_processor proc(resource);
+        proc.assign(dst, src);
+        return dst;
+    }
+
+    template<class T>
+    void reflect_swap(T &lhs, T &rhs)
+    {
+        reflect_swap_processor proc;
+        reflect2(proc, lhs, rhs);
+    }
+
+    template<class T>
+    void reflect_move_into(T &dst, T &src)
+    {
+        reflect_move_processor proc;
+        reflect2(proc, dst, src);
+    }
+
+} // namespace cora
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cora
+{
+namespace reflection
+{
+    // enum <-> string mapping built by ENUM_DECL ... ENUM_DECL_END
+    // enum -> string: dense array indexed by (value - min) when the values are compact, binary search otherwise
+    // string -> enum: open addressing hash table over std::string_view, no allocations on lookup
+    // iterating yields the declared (value, name) pairs in declaration order
+    template<typename E>
+    struct enum_table
+    {
+        static_assert(std::is_enum_v<E>, "enum_table is for enums only");
+
+        using value_type = std::pair<E, std::string>;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+
+        enum_table(std::initializer_list<std::pair<E, char const *>> entries)
+        {
+            entries_.reserve(entries.size());
+            for (auto const &e : entries)
+                entries_.emplace_back(e.first, e.second);
+
+            build_value_index();
+            build_name_index();
+        }
+
+        enum_table(enum_table const &) = delete;
+        enum_table &operator=(enum_table const &) = delete;
+
+        const_iterator begin() const { return entries_.begin(); }
+        const_iterator end() const { return entries_.end(); }
+        size_t size() const { return entries_.size(); }
+
+        // nullopt for undeclared values
+        std::optional<std::string_view> to_string(E value) const
+        {
+            int64_t const v = to_int(value);
+            if (!dense_.empty())
+            {
+                // unsigned, values below min_ wrap around past the end
+                uint64_t const offset = uint64_t(v) - uint64_t(min_);
+                if (offset >= dense_.size() || dense_[size_t(offset)] < 0)
+                    return std::nullopt;
+
+                return std::string_view(entries_[size_t(dense_[size_t(offset)])].second);
+            }
+
+            auto it = std::lower_bound(sorted_.begin(), sorted_.end(), v, [this](uint32_t idx, int64_t val)
+            {
+                return to_int(entries_[idx].first) < val;
+            });
+            if (it == sorted_.end() || to_int(entries_[*it].first) != v)
+                return std::nullopt;
+
+            return std::string_view(entries_[*it].second);
+        }
+
+        std::optional<E> from_string(std::string_view name) const
+        {
+            size_t const mask = slots_.size() - 1;
+            for (size_t pos = hash(name) & mask;; pos = (pos + 1) & mask)
+            {
+                int32_t const idx = slots_[pos];
+                if (idx < 0)
+                    return std::nullopt;
+
+                if (entries_[size_t(idx)].second == name)
+                    return entries_[size_t(idx)].first;
+            }
+        }
+
+    private:
+        static int64_t to_int(E value)
+        {
+            return int64_t(static_cast<std::underlying_type_t<E>>(value));
+        }
+
+        static size_t hash(std::string_view name)
+        {
+            uint64_t h = 14695981039346656037ull;
+            for (char c : name)
+                h = (h ^ uint64_t(static_cast<unsigned char>(c))) * 1099511628211ull;
+            return size_t(h ^ (h >> 32));
+        }
+
+        void build_value_index()
+        {
+            if (entries_.empty())
+                return;
+
+            int64_t min = to_int(entries_.front().first);
+            int64_t max = min;
+            for (auto const &e : entries_)
+            {
+                min = std::min(min, to_int(e.first));
+                max = std::max(max, to_int(e.first));
+            }
+
+            // dense only if it does not waste much more than the entries themselves;
+            // the span is unsigned, a signed one overflows for values as far apart as INT64_MIN and INT64_MAX
+            uint64_t const span = uint64_t(max) - uint64_t(min);
+            if (span < 4 * entries_.size() + 64)
+            {
+                min_ = min;
+                dense_.assign(size_t(span + 1), -1);
+                for (size_t i = entries_.size(); i-- > 0;) // the first declared name wins for aliases
+                    dense_[size_t(uint64_t(to_int(entries_[i].first)) - uint64_t(min))] = int32_t(i);
+            }
+            else
+            {
+                for (size_t i = 0; i < entries_.size(); ++i)
+                    sorted_.push_back(uint32_t(i));
+
+                std::stable_sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b)
+                {
+                    return to_int(entries_[a].first) < to_int(entries_[b].first);
+                });
+            }
+        }
+
+        void build_name_index()
+        {
+            size_t capacity = 4;
+            while (capacity < entries_.size() * 2)
+                capacity *= 2;
+
+            slots_.assign(capacity, -1);
+            for (size_t i = 0; i < entries_.size(); ++i)
+            {
+                size_t pos = hash(entries_[i].second) & (capacity - 1);
+                while (slots_[pos] >= 0)
+                    pos = (pos + 1) & (capacity - 1);
+
+                slots_[pos] = int32_t(i);
+            }
+        }
+
+    private:
+        std::vector<value_type> entries_;
+
+        int64_t min_ = 0;
+        std::vector<int32_t> dense_;
+        std::vector<uint32_t> sorted_;
+
+        std::vector<int32_t> slots_;
+    };
+
+    namespace detail
+    {
+        template<typename E, typename = void>
+        struct has_enum_decl : std::false_type {};
+
+        template<typename E>
+        struct has_enum_decl<E, std::void_t<decltype(enum_string_match_detail(static_cast<E const *>(nullptr)))>> : std::true_type {};
+    } // namespace detail
+
+    // true for enums declared with ENUM_DECL / ENUM_DECL_INNER
+    template<typename E>
+    constexpr bool is_enum_declared_v = std::is_enum_v<E> && detail::has_enum_decl<E>::value;
+
+    template<typename E>
+    enum_table<E> const &enum_table_of()
+    {
+        return enum_string_match_detail(static_cast<E const *>(nullptr));
+    }
+
+} // namespace reflection
+
+    template<typename E>
+    std::optional<std::string_view> enum_to_string(E value)
+    {
+        return cora::reflection::enum_table_of<E>().to_string(value);
+    }
+
+    template<typename E>
+    std::optional<E> string_to_enum(std::string_view name)
+    {
+        return cora::reflection::enum_table_of<E>().from_string(name);
+    }
+
+} // namespace cora
@@ -0,0 +1,407 @@
+#pragma once
+
+// Per-field instrumentation of the reflection processors.
+// Everything below compiles to nothing unless CORA_ENABLE_INSTRUMENTATION is defined.
+//
+// Collected per field path ("root;position;x", built from REFL_ENTRY names):
+// calls, bytes emitted or consumed, container elements, allocations and time.
+// Allocations are counted only if the program reports them with note_allocation(),
+// e.g. by putting CORA_INSTRUMENTATION_DEFINE_NEW() into one translation unit.
+// Time and allocations spent inside an overhead_scope (e.g. measuring the bytes) are
+// not charged to the enclosing fields.
+//
+// Statistics are gathered per thread, see profiler::instance().
+
+#include "cora/reflection/reflection.h"
+
+#ifdef CORA_ENABLE_INSTRUMENTATION
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cora
+{
+namespace instrumentation
+{
+    struct field_stats
+    {
+        uint64_t calls       = 0;
+        uint64_t bytes       = 0;
+        uint64_t elements    = 0;
+        uint64_t allocations = 0;
+        std::chrono::nanoseconds total_time{};
+        std::chrono::nanoseconds self_time{};
+    };
+
+    inline uint64_t &allocation_counter()
+    {
+        thread_local uint64_t counter = 0;
+        return counter;
+    }
+
+    // to be called from the program allocation functions
+    inline void note_allocation()
+    {
+        ++allocation_counter();
+    }
+
+    struct profiler
+    {
+        static profiler &instance()
+        {
+            thread_local profiler p;
+            return p;
+        }
+
+        profiler()
+            : nodes_(1)
+        {
+            nodes_.front().name = "root";
+        }
+
+        void enter(std::string_view name)
+        {
+            size_t const parent = stack_.empty() ? 0 : stack_.back().node;
+
+            auto &children = nodes_[parent].children;
+            auto it = children.find(name);
+            if (it == children.end())
+            {
+                it = children.emplace(std::string(name), nodes_.size()).first;
+                nodes_.emplace_back();
+                nodes_.back().name = name;
+            }
+
+            stack_.push_back({ it->second, std::chrono::nanoseconds{}, {} });
+        }
+
+        void leave(std::chrono::nanoseconds elapsed, uint64_t bytes, uint64_t elements, uint64_t allocations)
+        {
+            auto const frame = std::move(stack_.back());
+            stack_.pop_back();
+
+            auto &stats = nodes_[frame.node].stats;
+            stats.calls       += 1;
+            stats.bytes       += bytes;
+            stats.elements    += elements;
+            stats.allocations += allocations;
+            stats.total_time  += elapsed;
+            stats.self_time   += elapsed - frame.children_time;
+
+            if (!stack_.empty())
+                stack_.back().children_time += elapsed;
+        }
+
+        void reset()
+        {
+            *this = profiler();
+        }
+
+        void add_overhead(std::chrono::nanoseconds elapsed, uint64_t allocations)
+        {
+            overhead_time_        += elapsed;
+            overhead_allocations_ += allocations;
+        }
+
+        std::chrono::nanoseconds overhead_time() const
+        {
+            return overhead_time_;
+        }
+
+        uint64_t overhead_allocations() const
+        {
+            return overhead_allocations_;
+        }
+
+        // byte count of something nested in the current field, for the enclosing field to reuse
+        void share_bytes(void const *key, uint64_t bytes)
+        {
+            if (stack_.size() > 1)
+                stack_[stack_.size() - 2].nested_bytes[key] = bytes;
+        }
+
+        // byte count shared by a field nested in the current one
+        uint64_t const *nested_bytes(void const *key) const
+        {
+            if (stack_.empty())
+                return nullptr;
+
+            auto const &nested = stack_.back().nested_bytes;
+            auto it = nested.find(key);
+            return it == nested.end() ? nullptr : &it->second;
+        }
+
+        // "path calls bytes elements allocations total_us self_us", heaviest total time first
+        void report(std::ostream &s) const
+        {
+            std::vector<std::pair<std::string, field_stats>> rows;
+            collect(0, std::string(), rows);
+            std::sort(rows.begin(), rows.end(), [](auto const &a, auto const &b)
+            {
+                return a.second.total_time > b.second.total_time;
+            });
+
+            s << std::left << std::setw(48) << "path"
+              << std::right << std::setw(12) << "calls" << std::setw(14) << "bytes" << std::setw(12) << "elements"
+              << std::setw(12) << "allocs" << std::setw(14) << "total_us" << std::setw(14) << "self_us" << "\n";
+
+            for (auto const &row : rows)
+            {
+                auto const &st = row.second;
+                s << std::left << std::setw(48) << row.first
+                  << std::right << std::setw(12) << st.calls << std::setw(14) << st.bytes << std::setw(12) << st.elements
+                  << std::setw(12) << st.allocations << std::setw(14) << to_us(st.total_time) << std::setw(14) << to_us(st.self_time) << "\n";
+            }
+        }
+
+        // folded stacks ("root;a;b self_us"), the input of flamegraph.pl and compatible tools
+        void write_folded(std::ostream &s) const
+        {
+            std::vector<std::pair<std::string, field_stats>> rows;
+            collect(0, std::string(), rows);
+
+            for (auto const &row : rows)
+                s << row.first << " " << to_us(row.second.self_time) << "\n";
+        }
+
+        // path as in the report, e.g. "root;position;x"
+        field_stats const *find(std::string const &path) const
+        {
+            size_t const idx = index_of(path);
+            return idx == 0 ? nullptr : &nodes_[idx].stats;
+        }
+
+    private:
+        struct node
+        {
+            std::string name;
+            field_stats stats;
+            std::map<std::string, size_t, std::less<>> children;
+        };
+
+        struct frame
+        {
+            size_t node;
+            std::chrono::nanoseconds children_time;
+            std::unordered_map<void const *, uint64_t> nested_bytes;
+        };
+
+        static uint64_t to_us(std::chrono::nanoseconds t)
+        {
+            return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(t).count());
+        }
+
+        void collect(size_t idx, std::string const &prefix, std::vector<std::pair<std::string, field_stats>> &rows) const
+        {
+            auto const &n = nodes_[idx];
+            std::string path = prefix.empty() ? n.name : prefix + ";" + n.name;
+            if (idx != 0)
+                rows.emplace_back(path, n.stats);
+
+            for (auto const &child : n.children)
+                collect(child.second, path, rows);
+        }
+
+        size_t index_of(std::string const &path) const
+        {
+            size_t idx = 0;
+            size_t pos = path.find(';');
+            if (path.compare(0, pos, nodes_.front().name) != 0)
+                return 0;
+
+            while (pos != std::string::npos)
+            {
+                size_t const next = path.find(';', pos + 1);
+                auto const &children = nodes_[idx].children;
+                auto it = children.find(path.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1));
+                if (it == children.end())
+                    return 0;
+
+                idx = it->second;
+                pos = next;
+            }
+            return idx;
+        }
+
+    private:
+        std::vector<node> nodes_;
+        std::vector<frame> stack_;
+        std::chrono::nanoseconds overhead_time_{};
+        uint64_t overhead_allocations_ = 0;
+    };
+
+    // time and allocations of the measurement itself, subtracted from the enclosing fields
+    struct overhead_scope
+    {
+        overhead_scope()
+            : start_(std::chrono::steady_clock::now())
+            , allocations_(allocation_counter())
+        {
+        }
+
+        ~overhead_scope()
+        {
+            auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+            profiler::instance().add_overhead(elapsed, allocation_counter() - allocations_);
+        }
+
+        overhead_scope(overhead_scope const &) = delete;
+        overhead_scope &operator=(overhead_scope const &) = delete;
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+        uint64_t allocations_;
+    };
+
+    // measures a single field visit, nested scopes form the field path
+    struct field_scope
+    {
+        explicit field_scope(std::string_view name)
+        {
+            // entering may allocate the path node, which is not the field's cost
+            auto &p = profiler::instance();
+            p.enter(name);
+            overhead_time_        = p.overhead_time();
+            overhead_allocations_ = p.overhead_allocations();
+            allocations_          = allocation_counter();
+            start_                = std::chrono::steady_clock::now();
+        }
+
+        ~field_scope()
+        {
+            auto const now = std::chrono::steady_clock::now();
+            auto const allocations = allocation_counter();
+
+            auto &p = profiler::instance();
+            auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_) - (p.overhead_time() - overhead_time_);
+            p.leave(elapsed, bytes_, elements_, allocations - allocations_ - (p.overhead_allocations() - overhead_allocations_));
+        }
+
+        field_scope(field_scope const &) = delete;
+        field_scope &operator=(field_scope const &) = delete;
+
+        void add_bytes(uint64_t n)
+        {
+            bytes_ += n;
+        }
+
+        void add_elements(uint64_t n)
+        {
+            elements_ += n;
+        }
+
+        // see profiler::share_bytes
+        void share_bytes(void const *key, uint64_t n)
+        {
+            profiler::instance().share_bytes(key, n);
+        }
+
+        uint64_t const *nested_bytes(void const *key) const
+        {
+            return profiler::instance().nested_bytes(key);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+        std::chrono::nanoseconds overhead_time_{};
+        uint64_t overhead_allocations_ = 0;
+        uint64_t allocations_          = 0;
+        uint64_t bytes_                = 0;
+        uint64_t elements_             = 0;
+    };
+
+    // wraps any processor (or processor2) so that each field it is called for is measured;
+    // fields of nested objects are measured only if the inner processor recurses through the wrapper
+    template<class Processor>
+    struct instrumented
+        : std::conditional_t<std::is_base_of_v<cora::reflection::processor2, Processor>,
+            cora::reflection::processor2, cora::reflection::processor_base>
+    {
+        explicit instrumented(Processor &proc)
+            : proc_(proc)
+        {
+        }
+
+        template<class T, class... Args>
+        void operator()(T &&v, Args &&... args)
+        {
+            call(std::forward<T>(v), std::forward<Args>(args)...);
+        }
+
+        Processor &inner()
+        {
+            return proc_;
+        }
+
+    private:
+        template<class T, class Name, class... Tags>
+        void call(T &&v, Name &&name, Tags &&... tags)
+        {
+            if constexpr (std::is_base_of_v<cora::reflection::processor2, Processor>)
+            {
+                // here name is rhs, the real name goes next
+                call2(std::forward<T>(v), std::forward<Name>(name), std::forward<Tags>(tags)...);
+            }
+            else
+            {
+                field_scope scope(name);
+                proc_(std::forward<T>(v), std::forward<Name>(name), std::forward<Tags>(tags)...);
+            }
+        }
+
+        template<class L, class R, class Name, class... Tags>
+        void call2(L &&l, R &&r, Name &&name, Tags &&... tags)
+        {
+            field_scope scope(name);
+            proc_(std::forward<L>(l), std::forward<R>(r), std::forward<Name>(name), std::forward<Tags>(tags)...);
+        }
+
+    private:
+        Processor &proc_;
+    };
+
+} // namespace instrumentation
+} // namespace cora
+
+#define CORA_INSTRUMENT_FIELD(scope, name)          cora::instrumentation::field_scope scope(name)
+#define CORA_INSTRUMENT_BYTES(scope, n)             scope.add_bytes(uint64_t(n))
+#define CORA_INSTRUMENT_ELEMENTS(scope, n)          scope.add_elements(uint64_t(n))
+#define CORA_INSTRUMENT_CODE(...)                   __VA_ARGS__
+
+// replaces the global operator new/delete with counting ones, use in exactly one translation unit
+#define CORA_INSTRUMENTATION_DEFINE_NEW()                                     \
+    void *operator new(std::size_t size)                                      \
+    {                                                                         \
+        cora::instrumentation::note_allocation();                             \
+        if (void *p = std::malloc(size ? size : 1))                           \
+            return p;                                                         \
+        throw std::bad_alloc();                                               \
+    }                                                                         \
+    void operator delete(void *p) noexcept                                    \
+    {                                                                         \
+        std::free(p);                                                         \
+    }                                                                         \
+    void operator delete(void *p, std::size_t) noexcept                       \
+    {                                                                         \
+        std::free(p);                                                         \
+    }
+
+#else
+
+#define CORA_INSTRUMENT_FIELD(scope, name)
+#define CORA_INSTRUMENT_BYTES(scope, n)
+#define CORA_INSTRUMENT_ELEMENTS(scope, n)
+#define CORA_INSTRUMENT_CODE(...)
+#define CORA_INSTRUMENTATION_DEFINE_NEW()
+
+#endif // CORA_ENABLE_INSTRUMENTATION
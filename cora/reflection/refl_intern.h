@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace cora
+{
+    // REFL_ENTRY_TAG(unit, cora::interned): the std::string_view field, or the string_view elements, values and keys
+    // of the containers in it, are decoded as views into a cora::string_pool given to the reader,
+    // so every distinct string is stored once however many objects hold it
+    struct intern_tag
+    {
+    };
+
+    constexpr intern_tag interned{};
+
+    // Deduplicating storage of immutable strings: intern() returns a view of the single copy of its argument,
+    // null-terminated and valid until the pool is cleared or destroyed.
+    // Not thread-safe, a pool shared between decoding threads needs external locking.
+    struct string_pool
+    {
+        explicit string_pool(size_t chunk_size = 16 * 1024)
+            : chunk_size_(chunk_size)
+        {
+        }
+
+        string_pool(string_pool const &) = delete;
+        string_pool &operator=(string_pool const &) = delete;
+
+        std::string_view intern(std::string_view s)
+        {
+            ++lookups_;
+            auto it = strings_.find(s);
+            if (it != strings_.end())
+                return *it;
+
+            std::string_view const stored(store(s), s.size());
+            strings_.insert(stored);
+            bytes_ += s.size();
+            return stored;
+        }
+
+        // distinct strings
+        size_t size() const
+        {
+            return strings_.size();
+        }
+
+        // characters of the distinct strings
+        size_t bytes() const
+        {
+            return bytes_;
+        }
+
+        // intern() calls, lookups() - size() of them returned an existing string
+        size_t lookups() const
+        {
+            return lookups_;
+        }
+
+        // invalidates every view returned so far
+        void clear()
+        {
+            strings_.clear();
+            chunks_.clear();
+            free_ = nullptr;
+            free_size_ = 0;
+            bytes_ = 0;
+            lookups_ = 0;
+        }
+
+    private:
+        char const *store(std::string_view s)
+        {
+            size_t const size = s.size() + 1;
+
+            char *dst;
+            if (size > chunk_size_ / 4)
+            {
+                // large strings get their own allocation, not to waste the rest of the current chunk
+                chunks_.emplace_back(new char[size]);
+                dst = chunks_.back().get();
+            }
+            else
+            {
+                if (size > free_size_)
+                {
+                    chunks_.emplace_back(new char[chunk_size_]);
+                    free_ = chunks_.back().get();
+                    free_size_ = chunk_size_;
+                }
+
+                dst = free_;
+                free_ += size;
+                free_size_ -= size;
+            }
+
+            std::copy(s.begin(), s.end(), dst);
+            dst[s.size()] = 0;
+            return dst;
+        }
+
+    private:
+        size_t chunk_size_;
+        std::vector<std::unique_ptr<char[]>> chunks_;
+        char *free_ = nullptr;
+        size_t free_size_ = 0;
+
+        std::unordered_set<std::string_view> strings_;
+        size_t bytes_ = 0;
+        size_t lookups_ = 0;
+    };
+
+} // namespace cora
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_soa.h"
+#include "cora/reflection/refl_tracked.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_variant.h"
+
+namespace cora
+{
+    // Memory footprint of the values found at one path of a reflected object.
+    // Paths are made of the REFL_ENTRY names: "orders[].target" for the elements of a container,
+    // "index[].first" / "index[].second" for the keys and values of a map, "order.1" for the alternative 1 of a variant,
+    // optionals and tracked values add nothing to the path of their value.
+    struct memory_usage_entry
+    {
+        std::string path;           // "" is the root
+        size_t count = 0;           // values seen at the path
+        size_t shallow_bytes = 0;   // sizeof of those values, the nested paths included
+        size_t heap_bytes = 0;      // heap held by the values themselves: buffers, nodes, buckets
+        size_t deep_bytes = 0;      // heap held by the values and everything nested in them
+        size_t slack_bytes = 0;     // unused capacity of vectors and strings, a part of heap_bytes
+        size_t overhead_bytes = 0;  // bookkeeping: container nodes and buckets (estimated), optional flags and padding
+        size_t inline_strings = 0;  // strings held in the small string buffer, without heap
+    };
+
+    struct memory_report
+    {
+        // the root first, every path after its parent
+        std::vector<memory_usage_entry> entries;
+
+        memory_usage_entry const &root() const
+        {
+            return entries.front();
+        }
+
+        // inline size of the root objects plus all the heap they hold
+        size_t total_bytes() const
+        {
+            return root().shallow_bytes + root().deep_bytes;
+        }
+
+        memory_usage_entry const *find(std::string_view path) const
+        {
+            for (auto const &e : entries)
+            {
+                if (e.path == path)
+                    return &e;
+            }
+            return nullptr;
+        }
+
+        // the paths holding most of the heap themselves, i.e. where to optimize
+        std::vector<memory_usage_entry const *> top_heap(size_t n) const
+        {
+            return top(n, &memory_usage_entry::heap_bytes);
+        }
+
+        // the paths wasting most of the capacity, shrink_to_fit or reserve candidates
+        std::vector<memory_usage_entry const *> top_slack(size_t n) const
+        {
+            return top(n, &memory_usage_entry::slack_bytes);
+        }
+
+        void print(std::ostream &s, size_t n = 10) const
+        {
+            auto const &r = root();
+            s << "total " << total_bytes() << " bytes: inline " << r.shallow_bytes << ", heap " << r.deep_bytes
+              << ", slack " << sum(&memory_usage_entry::slack_bytes) << ", overhead " << sum(&memory_usage_entry::overhead_bytes) << "\n";
+
+            print_top(s, "top heap", top_heap(n));
+            print_top(s, "top slack", top_slack(n));
+        }
+
+    private:
+        std::vector<memory_usage_entry const *> top(size_t n, size_t memory_usage_entry::*field) const
+        {
+            std::vector<memory_usage_entry const *> result;
+            for (auto const &e : entries)
+            {
+                if (e.*field != 0)
+                    result.push_back(&e);
+            }
+
+            n = std::min(n, result.size());
+            std::partial_sort(result.begin(), result.begin() + n, result.end(),
+                [field](auto const *a, auto const *b) { return a->*field > b->*field; });
+            result.resize(n);
+            return result;
+        }
+
+        size_t sum(size_t memory_usage_entry::*field) const
+        {
+            size_t total = 0;
+            for (auto const &e : entries)
+                total += e.*field;
+            return total;
+        }
+
+        static void print_top(std::ostream &s, char const *title, std::vector<memory_usage_entry const *> const &top)
+        {
+            s << title << ":\n";
+            s << std::setw(14) << "heap" << std::setw(14) << "deep" << std::setw(14) << "slack" << std::setw(12) << "count" << "  path\n";
+            for (auto const *e : top)
+            {
+                s << std::setw(14) << e->heap_bytes << std::setw(14) << e->deep_bytes << std::setw(14) << e->slack_bytes
+                  << std::setw(12) << e->count << "  " << (e->path.empty() ? "<root>" : e->path) << "\n";
+            }
+        }
+    };
+
+    namespace detail
+    {
+        template<typename T, typename = void>
+        struct has_capacity : std::false_type {};
+
+        template<typename T>
+        struct has_capacity<T, std::void_t<decltype(std::declval<T const &>().capacity())>> : std::true_type {};
+
+        template<typename T, typename = void>
+        struct has_bucket_count : std::false_type {};
+
+        template<typename T>
+        struct has_bucket_count<T, std::void_t<decltype(std::declval<T const &>().bucket_count())>> : std::true_type {};
+
+        template<typename T, typename = void>
+        struct is_tuple_like : std::false_type {};
+
+        template<typename T>
+        struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+        template<typename T>
+        struct is_pair : std::false_type {};
+
+        template<typename First, typename Second>
+        struct is_pair<std::pair<First, Second>> : std::true_type {};
+
+        template<typename T>
+        struct is_vector_bool : std::false_type {};
+
+        template<typename Alloc>
+        struct is_vector_bool<std::vector<bool, Alloc>> : std::true_type {};
+
+        inline char const *index_name(size_t idx)
+        {
+            static char const *const names[] = {
+                "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15",
+                "16", "17", "18", "19", "20", "21", "22", "23", "24", "25", "26", "27", "28", "29", "30", "31",
+            };
+            return idx < std::size(names) ? names[idx] : "n";
+        }
+
+        // walks the objects keeping a node per path; the children of a node are found by the address of their name,
+        // which is a string literal (or a static string) for every kind of path element
+        struct memory_accountant
+        {
+            memory_accountant()
+                : nodes_(1)
+            {
+            }
+
+            template<typename T>
+            void add(T const &obj)
+            {
+                account(obj, 0);
+            }
+
+            memory_report report() const
+            {
+                memory_report r;
+                r.entries.reserve(nodes_.size());
+                for (auto const &node : nodes_)
+                {
+                    r.entries.push_back(node.usage);
+                    if (node.name)
+                    {
+                        auto const &parent = r.entries[node.parent];
+                        r.entries.back().path = parent.path.empty() || node.name[0] == '['
+                            ? parent.path + node.name
+                            : parent.path + "." + node.name;
+                    }
+                }
+                return r;
+            }
+
+        private:
+            struct field_processor
+            {
+                template<typename T>
+                void operator()(T const &v, char const *name, ...)
+                {
+                    deep += self.account(v, self.child(node, name));
+                }
+
+                memory_accountant &self;
+                size_t node;
+                size_t deep = 0;
+            };
+
+            struct node_t
+            {
+                char const *name = nullptr;
+                size_t parent = 0;
+                std::vector<std::pair<char const *, size_t>> children;
+                memory_usage_entry usage;
+            };
+
+            size_t child(size_t node, char const *name)
+            {
+                for (auto const &c : nodes_[node].children)
+                {
+                    if (c.first == name)
+                        return c.second;
+                }
+
+                size_t const idx = nodes_.size();
+                nodes_.emplace_back();
+                nodes_.back().name = name;
+                nodes_.back().parent = node;
+                nodes_[node].children.emplace_back(name, idx);
+                return idx;
+            }
+
+            memory_usage_entry &usage(size_t node)
+            {
+                return nodes_[node].usage;
+            }
+
+            // returns the deep bytes of v
+            template<typename T>
+            size_t account(T const &v, size_t node)
+            {
+                usage(node).count += 1;
+                usage(node).shallow_bytes += sizeof(T);
+
+                size_t const deep = add_heap(v, node);
+                usage(node).deep_bytes += deep;
+                return deep;
+            }
+
+            // count values of a type that holds no heap at once, e.g. the elements of a std::vector<double>
+            template<typename T>
+            void account_flat(size_t count, size_t node)
+            {
+                usage(node).count += count;
+                usage(node).shallow_bytes += count * sizeof(T);
+            }
+
+            template<typename T>
+            size_t add_heap(T const &v, size_t node)
+            {
+                namespace traits = cora::reflection::traits;
+
+                if constexpr (traits::is_tracked<T>::value)
+                {
+                    usage(node).overhead_bytes += sizeof(T) - sizeof(typename T::value_type);
+                    return add_heap(v.get(), node);
+                }
+                else if constexpr (traits::is_optional<T>::value)
+                {
+                    usage(node).overhead_bytes += sizeof(T) - sizeof(typename T::value_type);
+                    return v ? add_heap(*v, node) : 0;
+                }
+                else if constexpr (traits::is_variant<T>::value)
+                {
+                    if (v.valueless_by_exception())
+                        return 0;
+
+                    return cora::reflection::visit_index<T>(v.index(), [this, &v, node](auto idx)
+                    {
+                        auto const &alternative = std::get<decltype(idx)::value>(v);
+                        usage(node).overhead_bytes += sizeof(T) - sizeof(alternative);
+                        return account(alternative, child(node, index_name(decltype(idx)::value)));
+                    });
+                }
+                else if constexpr (traits::is_basic_string<T>::value)
+                    return add_string(v, node);
+                else if constexpr (traits::is_soa_vector<T>::value)
+                    return add_soa(v, node);
+                else if constexpr (cora::reflection::is_reflected_v<T>)
+                {
+                    field_processor proc{ *this, node };
+                    reflect(proc, v);
+                    return proc.deep;
+                }
+                else if constexpr (traits::is_container<T>::value)
+                    return add_container(v, node);
+                else if constexpr (is_pair<T>::value)
+                {
+                    return account(v.first, child(node, "first"))
+                        + account(v.second, child(node, "second"));
+                }
+                else if constexpr (is_tuple_like<T>::value)
+                    return add_tuple(v, node, std::make_index_sequence<std::tuple_size<T>::value>());
+                else
+                {
+                    // arithmetic, enums, string views, pointers: no heap of their own
+                    return 0;
+                }
+            }
+
+            template<typename T>
+            size_t add_string(T const &v, size_t node)
+            {
+                using char_type = typename T::value_type;
+
+                // the small string buffer lives inside the object
+                auto const *data = reinterpret_cast<char const *>(v.data());
+                auto const *self = reinterpret_cast<char const *>(&v);
+                if (data >= self && data < self + sizeof(T))
+                {
+                    usage(node).inline_strings += 1;
+                    return 0;
+                }
+
+                size_t const heap = (v.capacity() + 1) * sizeof(char_type);
+                usage(node).heap_bytes += heap;
+                usage(node).slack_bytes += (v.capacity() - v.size()) * sizeof(char_type);
+                return heap;
+            }
+
+            template<typename T>
+            size_t add_soa(T const &v, size_t node)
+            {
+                auto const &names = T::column_names();
+                size_t deep = 0;
+                v.visit_columns([&](auto idx, auto const &column)
+                {
+                    using leaf_type = std::remove_cv_t<std::remove_reference_t<decltype(column[0])>>;
+
+                    size_t const heap = v.capacity() * sizeof(leaf_type);
+                    usage(node).heap_bytes += heap;
+                    usage(node).slack_bytes += (v.capacity() - v.size()) * sizeof(leaf_type);
+                    deep += heap;
+
+                    size_t const column_node = child(node, names[decltype(idx)::value].c_str());
+                    if constexpr (std::is_trivially_copyable_v<leaf_type>)
+                        account_flat<leaf_type>(column.size(), column_node);
+                    else
+                    {
+                        for (size_t i = 0; i < column.size(); ++i)
+                            deep += account(column[i], column_node);
+                    }
+                });
+                return deep;
+            }
+
+            template<typename T>
+            size_t add_container(T const &v, size_t node)
+            {
+                using value_type = typename T::value_type;
+                constexpr size_t word = sizeof(void *);
+
+                size_t heap = 0;
+                if constexpr (is_vector_bool<T>::value)
+                {
+                    heap = (v.capacity() + 7) / 8;
+                    usage(node).slack_bytes += (v.capacity() - v.size()) / 8;
+                }
+                else if constexpr (has_capacity<T>::value)
+                {
+                    heap = v.capacity() * sizeof(value_type);
+                    usage(node).slack_bytes += (v.capacity() - v.size()) * sizeof(value_type);
+                }
+                else if constexpr (has_bucket_count<T>::value)
+                {
+                    // a node per element with the next pointer and the cached hash, plus the bucket array
+                    heap = v.size() * (sizeof(value_type) + 2 * word) + v.bucket_count() * word;
+                    usage(node).overhead_bytes += heap - v.size() * sizeof(value_type);
+                }
+                else if constexpr (!is_tuple_like<T>::value)
+                {
+                    // a node per element: three links and the color for trees, two links for lists (std::array holds none)
+                    size_t const node_overhead = (has_key_type<T>::value ? 4 : 2) * word;
+                    heap = v.size() * (sizeof(value_type) + node_overhead);
+                    usage(node).overhead_bytes += v.size() * node_overhead;
+                }
+
+                usage(node).heap_bytes += heap;
+
+                size_t const element_node = child(node, "[]");
+                if constexpr (std::is_trivially_copyable_v<value_type>)
+                {
+                    account_flat<value_type>(v.size(), element_node);
+                    return heap;
+                }
+                else
+                {
+                    size_t deep = heap;
+                    for (auto const &elem : v)
+                        deep += account(static_cast<value_type const &>(elem), element_node);
+                    return deep;
+                }
+            }
+
+            template<typename T, size_t... I>
+            size_t add_tuple(T const &v, size_t node, std::index_sequence<I...>)
+            {
+                return (size_t(0) + ... + account(std::get<I>(v), child(node, index_name(I))));
+            }
+
+            template<typename T, typename = void>
+            struct has_key_type : std::false_type {};
+
+            template<typename T>
+            struct has_key_type<T, std::void_t<typename T::key_type>> : std::true_type {};
+
+        private:
+            std::vector<node_t> nodes_;
+        };
+
+    } // namespace detail
+
+    // Heap and inline bytes of a reflected object per field path, see memory_usage_entry.
+    // Buffers are counted by capacity and nodes of maps, sets and lists by an estimate of the standard library layout,
+    // allocator rounding is not counted. Pointers are not followed.
+    template<typename T>
+    memory_report memory_usage(T const &obj)
+    {
+        detail::memory_accountant accountant;
+        accountant.add(obj);
+        return accountant.report();
+    }
+
+    // the same for a set of objects of the same type, e.g. the snapshots kept in a cache, aggregated by path
+    template<typename It>
+    memory_report memory_usage(It first, It last)
+    {
+        detail::memory_accountant accountant;
+        for (; first != last; ++first)
+            accountant.add(*first);
+        return accountant.report();
+    }
+
+} // namespace cora
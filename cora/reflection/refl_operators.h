@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_variant.h"
 
 namespace cora
 {
@@ -13,10 +14,23 @@ namespace cora
         {}
 
         template<class T>
-        void operator()(T &lhs, T &rhs, char const * /*name*/, ...)
+        void operator()(T &lhs, T &rhs, char const *name, ...)
         {
             if (not_eq_) return;
-            if (lhs != rhs)
+            if constexpr (cora::reflection::traits::is_variant<std::remove_const_t<T>>::value)
+            {
+                // the active alternatives go through the processor, so that nested variants are dispatched the same way
+                if (lhs.index() != rhs.index())
+                    not_eq_ = true;
+                else if (!lhs.valueless_by_exception())
+                {
+                    cora::reflection::visit_index<std::remove_const_t<T>>(lhs.index(), [&](auto idx)
+                    {
+                        (*this)(std::get<decltype(idx)::value>(lhs), std::get<decltype(idx)::value>(rhs), name);
+                    });
+                }
+            }
+            else if (lhs != rhs)
                 not_eq_ = true;
         }
 
@@ -38,12 +52,31 @@ namespace cora
         {}
 
         template<class T>
-        void operator()(T &lhs, T &rhs, char const * /*name*/, ...)
+        void operator()(T &lhs, T &rhs, char const *name, ...)
         {
             if (stop_) return;
-            if (lhs == rhs) return;
-            stop_ = true;
-            result_ = lhs < rhs;
+            if constexpr (cora::reflection::traits::is_variant<std::remove_const_t<T>>::value)
+            {
+                // ordered by the index first, valueless (index npos) before everything else, as std::variant does
+                if (lhs.index() != rhs.index())
+                {
+                    stop_ = true;
+                    result_ = lhs.index() + 1 < rhs.index() + 1;
+                }
+                else if (!lhs.valueless_by_exception())
+                {
+                    cora::reflection::visit_index<std::remove_const_t<T>>(lhs.index(), [&](auto idx)
+                    {
+                        (*this)(std::get<decltype(idx)::value>(lhs), std::get<decltype(idx)::value>(rhs), name);
+                    });
+                }
+            }
+            else
+            {
+                if (lhs == rhs) return;
+                stop_ = true;
+                result_ = lhs < rhs;
+            }
         }
 
         bool get_result() const
@@ -56,14 +89,30 @@ namespace cora
         bool stop_;
     };
 
+    // templates, so that ENABLE_REFL_EQ/CMP may go before REFL_INNER in the class body:
+    // the fields are looked up at instantiation, when the class is complete
+    template<class T>
+    bool reflect_eq(T const &a, T const &b)
+    {
+        reflect_eq_processor proc;
+        reflect2(proc, a, b);
+        return proc.get_result();
+    }
+
+    template<class T>
+    bool reflect_less(T const &a, T const &b)
+    {
+        reflect_less_processor proc;
+        reflect2(proc, a, b);
+        return proc.get_result();
+    }
+
 } // namespace cora
 
 #define ENABLE_REFL_EQ(type)                               \
     friend bool operator==(type const &a, type const &b)   \
     {                                                      \
-        cora::reflect_eq_processor proc;              \
-        reflect2(proc, a, b);                              \
-        return proc.get_result();                          \
+        return cora::reflect_eq(a, b);                     \
     }                                                      \
     friend bool operator!=(type const &a, type const &b)   \
     {                                                      \
@@ -74,9 +123,7 @@ namespace cora
     ENABLE_REFL_EQ(type)                                   \
     friend bool operator<(type const &a, type const &b)    \
     {                                                      \
-        cora::reflect_less_processor proc;            \
-        reflect2(proc, a, b);                              \
-        return proc.get_result();                          \
+        return cora::reflect_less(a, b);                   \
     }                                                      \
     friend bool operator<=(type const &a, type const &b)   \
     {                                                      \
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_tracked.h"
+#include "cora/reflection/refl_variant.h"
+
+namespace cora
+{
+namespace reflection
+{
+    namespace detail
+    {
+        constexpr uint64_t fnv_offset = 14695981039346656037ull;
+        constexpr uint64_t fnv_prime  = 1099511628211ull;
+
+        constexpr uint64_t fnv1a(uint64_t h, char const *str)
+        {
+            for (; *str; ++str)
+                h = (h ^ uint64_t(static_cast<unsigned char>(*str))) * fnv_prime;
+
+            // terminator, so that {"ab", "c"} and {"a", "bc"} differ
+            return (h ^ 0xffu) * fnv_prime;
+        }
+
+        constexpr uint64_t fnv1a(uint64_t h, uint64_t value)
+        {
+            for (int i = 0; i < 8; ++i, value >>= 8)
+                h = (h ^ (value & 0xffu)) * fnv_prime;
+            return h;
+        }
+
+        template<typename T, typename = void>
+        struct is_tuple_like : std::false_type {};
+
+        template<typename T>
+        struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+        template<typename T>
+        constexpr uint64_t type_fingerprint();
+
+        template<typename T, std::size_t... I>
+        constexpr uint64_t tuple_fingerprint(std::index_sequence<I...>)
+        {
+            uint64_t h = fnv1a(fnv_offset, "tuple");
+            ((h = fnv1a(h, type_fingerprint<std::tuple_element_t<I, T>>())), ...);
+            return h;
+        }
+
+        template<typename T, std::size_t... I>
+        constexpr uint64_t variant_fingerprint(std::index_sequence<I...>)
+        {
+            uint64_t h = fnv1a(fnv_offset, "variant");
+            ((h = fnv1a(h, type_fingerprint<std::variant_alternative_t<I, T>>())), ...);
+            return h;
+        }
+
+        template<typename T>
+        constexpr uint64_t struct_fingerprint()
+        {
+            uint64_t h = fnv1a(fnv_offset, "struct");
+            constexpr auto fields = all_fields<T>();
+            std::apply([&h](auto const &... desc)
+            {
+                ((h = fnv1a(fnv1a(h, desc.name), type_fingerprint<typename std::decay_t<decltype(desc)>::member_type>())), ...);
+            }, fields);
+            return h;
+        }
+
+        // only the parts of a type that affect its serialized form are hashed:
+        // e.g. std::vector and std::list of the same element type are the same sequence
+        template<typename T>
+        constexpr uint64_t type_fingerprint()
+        {
+            using type = traits::remove_cvref_t<T>;
+
+            if constexpr (is_reflected_v<type>)
+                return struct_fingerprint<type>();
+            else if constexpr (traits::is_tracked<type>::value)
+                return type_fingerprint<typename type::value_type>();
+            else if constexpr (traits::is_optional<type>::value)
+                return fnv1a(fnv1a(fnv_offset, "optional"), type_fingerprint<typename type::value_type>());
+            else if constexpr (traits::is_string<type>::value)
+                return fnv1a(fnv1a(fnv_offset, "string"), uint64_t(sizeof(typename type::value_type)));
+            else if constexpr (traits::is_map<type>::value)
+                return fnv1a(fnv1a(fnv1a(fnv_offset, "map"), type_fingerprint<typename type::key_type>()), type_fingerprint<typename type::mapped_type>());
+            else if constexpr (is_tuple_like<type>::value)
+                return tuple_fingerprint<type>(std::make_index_sequence<std::tuple_size<type>::value>());
+            else if constexpr (traits::is_variant<type>::value)
+                return variant_fingerprint<type>(std::make_index_sequence<std::variant_size_v<type>>());
+            else if constexpr (traits::is_container<type>::value)
+                return fnv1a(fnv1a(fnv_offset, "sequence"), type_fingerprint<typename type::value_type>());
+            else if constexpr (std::is_enum_v<type>)
+                return fnv1a(fnv1a(fnv_offset, "enum"), type_fingerprint<std::underlying_type_t<type>>());
+            else if constexpr (std::is_same_v<type, bool>)
+                return fnv1a(fnv_offset, "bool");
+            else if constexpr (std::is_integral_v<type>)
+                return fnv1a(fnv1a(fnv_offset, std::is_signed_v<type> ? "int" : "uint"), uint64_t(sizeof(type)));
+            else if constexpr (std::is_floating_point_v<type>)
+                return fnv1a(fnv1a(fnv_offset, "float"), uint64_t(sizeof(type)));
+            else
+                return fnv1a(fnv1a(fnv_offset, "opaque"), uint64_t(sizeof(type)));
+        }
+
+    } // namespace detail
+
+    // 64-bit hash of the REFL_ENTRY names and types of T, REFL_CHAIN bases and nested reflected types included
+    // equal fingerprints mean that both sides serialize the same fields in the same order
+    // self-recursive types (e.g. a tree node holding a vector of itself) are not supported
+    template<typename T>
+    constexpr uint64_t schema_fingerprint_v = detail::type_fingerprint<T>();
+
+} // namespace reflection
+} // namespace cora
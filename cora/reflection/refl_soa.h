@@ -0,0 +1,602 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cora/reflection/reflection.h"
+
+namespace cora
+{
+    template<typename T>
+    struct soa_vector;
+
+    namespace detail
+    {
+        template<typename T>
+        struct is_soa_array : std::false_type {};
+
+        template<typename T, size_t N>
+        struct is_soa_array<std::array<T, N>> : std::true_type {};
+
+        // accessors of a flattened leaf: the chain of members and array elements from the record to the leaf
+        struct soa_root
+        {
+            template<typename U>
+            constexpr U &operator()(U &v) const
+            {
+                return v;
+            }
+        };
+
+        template<typename Outer, typename Desc>
+        struct soa_member
+        {
+            Outer outer;
+            Desc desc;
+
+            template<typename U>
+            constexpr decltype(auto) operator()(U &v) const
+            {
+                return desc.get(outer(v));
+            }
+        };
+
+        template<typename Outer, size_t I>
+        struct soa_element
+        {
+            Outer outer;
+
+            template<typename U>
+            constexpr decltype(auto) operator()(U &v) const
+            {
+                return outer(v)[I];
+            }
+        };
+
+        template<typename Leaf, typename Access>
+        struct soa_leaf
+        {
+            using type = Leaf;
+            Access access;
+        };
+
+        template<typename T, typename Access>
+        constexpr auto soa_flatten(Access access);
+
+        template<typename T, typename Access, size_t... I>
+        constexpr auto soa_flatten_array(Access access, std::index_sequence<I...>)
+        {
+            return std::tuple_cat(soa_flatten<typename T::value_type>(soa_element<Access, I>{ access })...);
+        }
+
+        // tuple of soa_leaf, one per arithmetic leaf of T in REFL_ENTRY order
+        template<typename T, typename Access>
+        constexpr auto soa_flatten(Access access)
+        {
+            if constexpr (cora::reflection::is_reflected_v<T>)
+            {
+                constexpr auto fields = cora::reflection::all_fields<T>();
+                return std::apply([access](auto const &... desc)
+                {
+                    return std::tuple_cat(soa_flatten<typename std::decay_t<decltype(desc)>::member_type>(
+                        soa_member<Access, std::decay_t<decltype(desc)>>{ access, desc })...);
+                }, fields);
+            }
+            else if constexpr (is_soa_array<T>::value)
+                return soa_flatten_array<T>(access, std::make_index_sequence<std::tuple_size_v<T>>());
+            else
+            {
+                static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>,
+                    "soa_vector leaves must be arithmetic types, enums or std::array of them");
+                return std::make_tuple(soa_leaf<T, Access>{ access });
+            }
+        }
+
+        // the same flattening at runtime for the names, the csv_io title of T: "pos_x", "arr_0"
+        template<typename T>
+        void soa_names(std::string const &path, std::vector<std::string> &names)
+        {
+            auto const child = [&path](std::string const &name)
+            {
+                return path.empty() ? name : path + "_" + name;
+            };
+
+            if constexpr (cora::reflection::is_reflected_v<T>)
+            {
+                cora::reflection::for_each_field<T>([&](auto const &desc)
+                {
+                    soa_names<typename std::decay_t<decltype(desc)>::member_type>(child(desc.name), names);
+                });
+            }
+            else if constexpr (is_soa_array<T>::value)
+            {
+                for (size_t i = 0; i < std::tuple_size_v<T>; ++i)
+                    soa_names<typename T::value_type>(child(std::to_string(i)), names);
+            }
+            else
+                names.push_back(path);
+        }
+
+        template<typename Leaves>
+        struct soa_columns;
+
+        template<typename... Leaf>
+        struct soa_columns<std::tuple<Leaf...>>
+        {
+            using type = std::tuple<typename Leaf::type *...>;
+        };
+
+    } // namespace detail
+
+    // contiguous view of a column
+    template<typename L>
+    struct soa_span
+    {
+        using value_type = std::remove_cv_t<L>;
+
+        soa_span(L *data, size_t size)
+            : data_(data)
+            , size_(size)
+        {
+        }
+
+        L *data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        L *begin() const { return data_; }
+        L *end() const { return data_ + size_; }
+
+        L &operator[](size_t i) const { return data_[i]; }
+
+    private:
+        L *data_;
+        size_t size_;
+    };
+
+    // proxy of a soa_vector row, converts to T and, if not Const, is assignable from it
+    template<typename T, bool Const>
+    struct soa_row
+    {
+        using owner_type = std::conditional_t<Const, soa_vector<T> const, soa_vector<T>>;
+
+        soa_row(owner_type &owner, size_t index)
+            : owner_(&owner)
+            , index_(index)
+        {
+        }
+
+        soa_row(soa_row const &) = default;
+
+        operator T() const
+        {
+            return load();
+        }
+
+        T load() const
+        {
+            return owner_->get(index_);
+        }
+
+        // the leaf I of the row, see soa_vector::column_names()
+        template<size_t I>
+        auto &get() const
+        {
+            return owner_->template column<I>()[index_];
+        }
+
+        size_t index() const
+        {
+            return index_;
+        }
+
+        template<bool C = Const, typename = std::enable_if_t<!C>>
+        soa_row const &operator=(T const &value) const
+        {
+            owner_->set(index_, value);
+            return *this;
+        }
+
+        // copies the values, as the assignment of T&
+        soa_row const &operator=(soa_row const &other) const
+        {
+            static_assert(!Const, "assignment to a const row");
+            owner_->set(index_, other.load());
+            return *this;
+        }
+
+        // swaps the values, as std::swap of T&, so that std::iter_swap and the algorithms built on it work
+        friend void swap(soa_row const &a, soa_row const &b)
+        {
+            static_assert(!Const, "swap of const rows");
+            T const tmp = a.load();
+            a = b;
+            b = tmp;
+        }
+
+    private:
+        owner_type *owner_;
+        size_t index_;
+    };
+
+    template<typename T, bool Const>
+    struct soa_iterator
+    {
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = soa_row<T, Const>;
+        using pointer           = void;
+        using owner_type        = typename reference::owner_type;
+
+        soa_iterator(owner_type *owner = nullptr, size_t index = 0)
+            : owner_(owner)
+            , index_(index)
+        {
+        }
+
+        reference operator*() const { return reference(*owner_, index_); }
+        reference operator[](difference_type n) const { return reference(*owner_, size_t(difference_type(index_) + n)); }
+
+        soa_iterator &operator++() { ++index_; return *this; }
+        soa_iterator &operator--() { --index_; return *this; }
+        soa_iterator operator++(int) { auto tmp = *this; ++index_; return tmp; }
+        soa_iterator operator--(int) { auto tmp = *this; --index_; return tmp; }
+
+        soa_iterator &operator+=(difference_type n) { index_ = size_t(difference_type(index_) + n); return *this; }
+        soa_iterator &operator-=(difference_type n) { index_ = size_t(difference_type(index_) - n); return *this; }
+        soa_iterator operator+(difference_type n) const { return soa_iterator(owner_, size_t(difference_type(index_) + n)); }
+        soa_iterator operator-(difference_type n) const { return soa_iterator(owner_, size_t(difference_type(index_) - n)); }
+        difference_type operator-(soa_iterator const &other) const { return difference_type(index_) - difference_type(other.index_); }
+
+        bool operator==(soa_iterator const &other) const { return index_ == other.index_; }
+        bool operator!=(soa_iterator const &other) const { return index_ != other.index_; }
+        bool operator<(soa_iterator const &other) const { return index_ < other.index_; }
+        bool operator>(soa_iterator const &other) const { return index_ > other.index_; }
+        bool operator<=(soa_iterator const &other) const { return index_ <= other.index_; }
+        bool operator>=(soa_iterator const &other) const { return index_ >= other.index_; }
+
+        friend soa_iterator operator+(difference_type n, soa_iterator const &it) { return it + n; }
+
+    private:
+        owner_type *owner_;
+        size_t index_;
+    };
+
+    // Structure of arrays container of a reflected type:
+    // every arithmetic leaf of T (nested reflected members and std::array elements flattened) is kept
+    // in its own contiguous column aligned to soa_vector::alignment bytes, so that a pass over a few fields
+    // reads only their columns and the loops over column() spans vectorize.
+    // Rows are accessed through proxies converting to and assignable from T.
+    template<typename T>
+    struct soa_vector
+    {
+        static_assert(cora::reflection::is_reflected_v<T>, "soa_vector is for reflected types");
+
+        using value_type      = T;
+        using size_type       = size_t;
+        using reference       = soa_row<T, false>;
+        using const_reference = soa_row<T, true>;
+        using iterator        = soa_iterator<T, false>;
+        using const_iterator  = soa_iterator<T, true>;
+
+        static constexpr size_t alignment = 64;
+
+    private:
+        static constexpr auto leaves_ = detail::soa_flatten<T>(detail::soa_root{});
+        using leaves_t  = std::remove_const_t<decltype(leaves_)>;
+        using columns_t = typename detail::soa_columns<leaves_t>::type;
+
+    public:
+        static constexpr size_t columns_count = std::tuple_size_v<leaves_t>;
+
+        template<size_t I>
+        using column_type = typename std::tuple_element_t<I, leaves_t>::type;
+
+        soa_vector() = default;
+
+        explicit soa_vector(std::vector<T> const &rows)
+        {
+            assign(rows.begin(), rows.end());
+        }
+
+        soa_vector(soa_vector const &other)
+        {
+            reserve(other.size_);
+            for_each_column([&](auto idx, auto *&col)
+            {
+                copy_n(std::get<decltype(idx)::value>(other.columns_), other.size_, col);
+            });
+            size_ = other.size_;
+        }
+
+        soa_vector(soa_vector &&other) noexcept
+            : columns_(std::exchange(other.columns_, columns_t()))
+            , size_(std::exchange(other.size_, 0))
+            , capacity_(std::exchange(other.capacity_, 0))
+        {
+        }
+
+        soa_vector &operator=(soa_vector const &other)
+        {
+            if (this != &other)
+            {
+                soa_vector tmp(other);
+                swap(tmp);
+            }
+            return *this;
+        }
+
+        soa_vector &operator=(soa_vector &&other) noexcept
+        {
+            soa_vector tmp(std::move(other));
+            swap(tmp);
+            return *this;
+        }
+
+        ~soa_vector()
+        {
+            for_each_column([](auto, auto *&col)
+            {
+                deallocate(col);
+            });
+        }
+
+        void swap(soa_vector &other) noexcept
+        {
+            std::swap(columns_, other.columns_);
+            std::swap(size_, other.size_);
+            std::swap(capacity_, other.capacity_);
+        }
+
+        template<typename It>
+        void assign(It first, It last)
+        {
+            clear();
+            if constexpr (std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>)
+                reserve(size_t(std::distance(first, last)));
+
+            for (; first != last; ++first)
+                push_back(*first);
+        }
+
+        std::vector<T> to_vector() const
+        {
+            std::vector<T> rows;
+            rows.reserve(size_);
+            for (size_t i = 0; i < size_; ++i)
+                rows.push_back(get(i));
+            return rows;
+        }
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return capacity_; }
+        bool empty() const { return size_ == 0; }
+
+        void reserve(size_t capacity)
+        {
+            if (capacity <= capacity_)
+                return;
+
+            for_each_column([this, capacity](auto, auto *&col)
+            {
+                auto *fresh = allocate<std::remove_reference_t<decltype(*col)>>(capacity);
+                copy_n(col, size_, fresh);
+                deallocate(col);
+                col = fresh;
+            });
+            capacity_ = capacity;
+        }
+
+        void resize(size_t size)
+        {
+            if (size > capacity_)
+                reserve(std::max(size, capacity_ * 2));
+
+            static T const value{};
+            for (size_t i = size_; i < size; ++i)
+                set(i, value);
+
+            size_ = size;
+        }
+
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        void push_back(T const &value)
+        {
+            if (size_ == capacity_)
+                reserve(std::max<size_t>(16, capacity_ * 2));
+
+            set(size_, value);
+            ++size_;
+        }
+
+        void pop_back()
+        {
+            --size_;
+        }
+
+        // the row gathered from the columns
+        T get(size_t i) const
+        {
+            T value{};
+            for_each_leaf([&](auto const &leaf, auto const *col)
+            {
+                leaf.access(value) = col[i];
+            });
+            return value;
+        }
+
+        void set(size_t i, T const &value)
+        {
+            for_each_leaf([&](auto const &leaf, auto *col)
+            {
+                col[i] = leaf.access(value);
+            });
+        }
+
+        reference operator[](size_t i) { return reference(*this, i); }
+        const_reference operator[](size_t i) const { return const_reference(*this, i); }
+
+        reference front() { return (*this)[0]; }
+        const_reference front() const { return (*this)[0]; }
+        reference back() { return (*this)[size_ - 1]; }
+        const_reference back() const { return (*this)[size_ - 1]; }
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end() { return iterator(this, size_); }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size_); }
+
+        template<size_t I>
+        soa_span<column_type<I>> column()
+        {
+            return soa_span<column_type<I>>(std::get<I>(columns_), size_);
+        }
+
+        template<size_t I>
+        soa_span<column_type<I> const> column() const
+        {
+            return soa_span<column_type<I> const>(std::get<I>(columns_), size_);
+        }
+
+        // column by name, throws std::out_of_range if there is no such column or it is not of type L
+        template<typename L>
+        soa_span<L> column(std::string_view name)
+        {
+            return soa_span<L>(find_column<std::remove_cv_t<L>>(name), size_);
+        }
+
+        template<typename L>
+        soa_span<L const> column(std::string_view name) const
+        {
+            return soa_span<L const>(const_cast<soa_vector *>(this)->find_column<std::remove_cv_t<L>>(name), size_);
+        }
+
+        // names of the columns in order, as in the csv_io title of T
+        static std::vector<std::string> const &column_names()
+        {
+            static std::vector<std::string> const names = []
+            {
+                std::vector<std::string> names;
+                detail::soa_names<T>(std::string(), names);
+                return names;
+            }();
+            return names;
+        }
+
+        // f(std::integral_constant<size_t, I>, column I span), columns in order
+        template<typename Func>
+        void visit_columns(Func &&f) const
+        {
+            visit_columns(f, std::make_index_sequence<columns_count>());
+        }
+
+    private:
+        template<typename Func, size_t... I>
+        void visit_columns(Func &f, std::index_sequence<I...>) const
+        {
+            (f(std::integral_constant<size_t, I>(), column<I>()), ...);
+        }
+
+        template<typename Func>
+        void for_each_column(Func &&f)
+        {
+            for_each_column(f, std::make_index_sequence<columns_count>());
+        }
+
+        template<typename Func, size_t... I>
+        void for_each_column(Func &f, std::index_sequence<I...>)
+        {
+            (f(std::integral_constant<size_t, I>(), std::get<I>(columns_)), ...);
+        }
+
+        template<typename Func>
+        void for_each_leaf(Func &&f) const
+        {
+            for_each_leaf(f, std::make_index_sequence<columns_count>());
+        }
+
+        template<typename Func, size_t... I>
+        void for_each_leaf(Func &f, std::index_sequence<I...>) const
+        {
+            (f(std::get<I>(leaves_), std::get<I>(columns_)), ...);
+        }
+
+        template<typename L>
+        L *find_column(std::string_view name)
+        {
+            auto const &names = column_names();
+            auto const it = std::find(names.begin(), names.end(), name);
+            if (it == names.end())
+                throw std::out_of_range("soa_vector: no column " + std::string(name));
+
+            size_t const idx = size_t(it - names.begin());
+            L *result = nullptr;
+            for_each_column([&](auto i, auto *col)
+            {
+                if constexpr (std::is_same_v<std::remove_reference_t<decltype(*col)>, L>)
+                {
+                    if (decltype(i)::value == idx)
+                        result = col;
+                }
+            });
+
+            if (!result)
+                throw std::out_of_range("soa_vector: column " + std::string(name) + " is of another type");
+            return result;
+        }
+
+        template<typename L>
+        static L *allocate(size_t count)
+        {
+            return static_cast<L *>(::operator new(count * sizeof(L), std::align_val_t(alignment)));
+        }
+
+        template<typename L>
+        static void deallocate(L *ptr)
+        {
+            if (ptr)
+                ::operator delete(ptr, std::align_val_t(alignment));
+        }
+
+        template<typename L>
+        static void copy_n(L const *src, size_t count, L *dst)
+        {
+            if (count != 0)
+                std::memcpy(dst, src, count * sizeof(L));
+        }
+
+    private:
+        columns_t columns_{};
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+
+namespace reflection
+{
+namespace traits
+{
+    template<typename T>
+    struct is_soa_vector : std::false_type {};
+
+    template<typename T>
+    struct is_soa_vector<cora::soa_vector<T>> : std::true_type {};
+
+} // namespace traits
+} // namespace reflection
+} // namespace cora
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_variant.h"
+
+namespace cora
+{
+    // Appends an order-preserving binary key of an object:
+    // comparing two keys bytewise (memcmp, std::string::compare) gives the same order as operator< of ENABLE_REFL_CMP,
+    // provided nested reflected types are compared with ENABLE_REFL_CMP too.
+    //
+    // Every field is encoded in REFL_ENTRY order and is self-delimiting:
+    //  - unsigned integers and enums: big-endian; signed integers: big-endian with the sign bit flipped
+    //  - floating point: IEEE bits, sign bit flipped for positives and all bits inverted for negatives; -0 is encoded as +0,
+    //    NaN has no place in operator< order and is not supported
+    //  - strings: bytes with 0x00 escaped as 0x00 0xff, terminated by 0x00 0x00
+    //  - optionals: 0x00 if empty, 0x01 and the value otherwise
+    //  - sequences, sets and maps: 0x01 before each element, 0x00 at the end
+    //  - pairs, tuples and reflected structs: the elements one after another
+    //  - variants: the alternative index as a byte, then the active alternative
+    struct sort_key_processor
+    {
+        explicit sort_key_processor(std::string &key)
+            : key_(key)
+        {
+        }
+
+        template<class T>
+        void operator()(T const &v, char const * /*name*/, ...)
+        {
+            encode(v);
+        }
+
+        template<class T>
+        void encode(T const &v)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect(*this, v);
+            else if constexpr (traits::is_optional<T>::value)
+            {
+                key_.push_back(v ? '\x01' : '\x00');
+                if (v)
+                    encode(*v);
+            }
+            else if constexpr (std::is_same_v<T, bool>)
+                key_.push_back(v ? '\x01' : '\x00');
+            else if constexpr (std::is_enum_v<T>)
+                encode(static_cast<std::underlying_type_t<T>>(v));
+            else if constexpr (std::is_integral_v<T>)
+            {
+                using unsigned_type = std::make_unsigned_t<T>;
+                auto bits = static_cast<unsigned_type>(v);
+                if constexpr (std::is_signed_v<T>)
+                    bits ^= unsigned_type(unsigned_type(1) << (sizeof(T) * 8 - 1));
+                put_big_endian(bits);
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only IEEE single and double precision are supported");
+                using bits_type = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+                bits_type const sign = bits_type(1) << (sizeof(T) * 8 - 1);
+
+                T const value = v == T(0) ? T(0) : v;
+                bits_type bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                bits = (bits & sign) ? ~bits : (bits | sign);
+                put_big_endian(bits);
+            }
+            else if constexpr (traits::is_string<T>::value)
+            {
+                static_assert(sizeof(typename T::value_type) == 1, "only narrow strings are supported");
+                for (auto c : v)
+                {
+                    key_.push_back(c);
+                    if (c == '\0')
+                        key_.push_back('\xff');
+                }
+                key_.push_back('\x00');
+                key_.push_back('\x00');
+            }
+            else if constexpr (traits::is_container<T>::value)
+            {
+                for (auto const &elem : v)
+                {
+                    key_.push_back('\x01');
+                    encode(elem);
+                }
+                key_.push_back('\x00');
+            }
+            else if constexpr (is_tuple_like<T>::value)
+                std::apply([this](auto const &... elems) { (encode(elems), ...); }, v);
+            else if constexpr (std::is_same_v<T, std::monostate>)
+            {
+            }
+            else if constexpr (traits::is_variant<T>::value)
+            {
+                static_assert(std::variant_size_v<T> < 255, "too many alternatives");
+
+                // valueless (index npos) goes first, as in operator<
+                key_.push_back(char(uint8_t(v.index() + 1)));
+                if (!v.valueless_by_exception())
+                {
+                    cora::reflection::visit_index<T>(v.index(), [this, &v](auto idx)
+                    {
+                        encode(std::get<decltype(idx)::value>(v));
+                    });
+                }
+            }
+            else
+                static_assert(sizeof(T) == 0, "type has no sort key encoding");
+        }
+
+    private:
+        template<typename T, typename = void>
+        struct is_tuple_like : std::false_type {};
+
+        template<typename T>
+        struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+        template<class U>
+        void put_big_endian(U bits)
+        {
+            for (int shift = int(sizeof(U) * 8) - 8; shift >= 0; shift -= 8)
+                key_.push_back(char((bits >> shift) & 0xff));
+        }
+
+    private:
+        std::string &key_;
+    };
+
+    template<class T>
+    void append_sort_key(std::string &key, T const &obj)
+    {
+        sort_key_processor proc(key);
+        proc.encode(obj);
+    }
+
+    template<class T>
+    std::string make_sort_key(T const &obj)
+    {
+        std::string key;
+        append_sort_key(key, obj);
+        return key;
+    }
+
+    namespace detail
+    {
+        struct sort_key_entry
+        {
+            uint64_t prefix; // 8 key bytes from the depth of its range, big-endian, zero padded
+            uint32_t index;
+        };
+
+        // entries whose keys have the same first depth bytes
+        struct sort_key_range
+        {
+            size_t begin;
+            size_t end;
+            size_t depth;
+        };
+
+        inline uint64_t key_prefix(std::string_view key, size_t depth = 0)
+        {
+            uint64_t prefix = 0;
+            for (size_t i = depth; i < depth + 8; ++i)
+                prefix = (prefix << 8) | (i < key.size() ? uint64_t(static_cast<unsigned char>(key[i])) : 0u);
+            return prefix;
+        }
+
+        // runs f(chunk_index, begin, end) over [0, count) split into equal non-empty chunks, one per thread
+        template<class Func>
+        void parallel_chunks(size_t count, unsigned threads, Func &&f)
+        {
+            size_t const chunk = (count + threads - 1) / threads;
+
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < threads && t * chunk < count; ++t)
+            {
+                size_t const begin = t * chunk;
+                size_t const end = std::min(count, begin + chunk);
+                workers.emplace_back([&f, t, begin, end] { f(size_t(t), begin, end); });
+            }
+            f(size_t(0), size_t(0), std::min(count, chunk));
+
+            for (auto &w : workers)
+                w.join();
+        }
+
+    } // namespace detail
+
+    // Sorts a random access container of reflected records in operator< order using all cores:
+    // keys are built in parallel, then entries (8-byte key prefix, index) are partitioned by the first key byte
+    // that is not the same for all of them (MSD radix pass). Buckets too big for one thread are partitioned again
+    // by their next differing byte, in parallel, going on to the next 8 key bytes once a bucket shares the prefix;
+    // the others are sorted right away, comparing full keys only on equal prefixes.
+    // The result is stable. Throws std::length_error for 2^32 records or more.
+    template<class Container>
+    void parallel_sort_by_key(Container &data, unsigned threads = 0)
+    {
+        using value_type = typename Container::value_type;
+        using detail::sort_key_entry;
+        using detail::sort_key_range;
+
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        size_t const count = data.size();
+        if (count < 2)
+            return;
+
+        if (count > std::numeric_limits<decltype(sort_key_entry::index)>::max())
+            throw std::length_error("parallel_sort_by_key: too many records for a 32-bit index");
+
+        // keys of a chunk share one buffer to avoid an allocation per record
+        std::vector<std::string> arenas(threads);
+        std::vector<std::string_view> keys(count);
+        std::vector<sort_key_entry> entries(count);
+        detail::parallel_chunks(count, threads, [&](size_t chunk, size_t begin, size_t end)
+        {
+            std::string &arena = arenas[chunk];
+            std::vector<size_t> ends;
+            ends.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i)
+            {
+                append_sort_key(arena, data[i]);
+                ends.push_back(arena.size());
+            }
+
+            for (size_t i = begin, key_begin = 0; i < end; key_begin = ends[i - begin], ++i)
+            {
+                keys[i] = std::string_view(arena).substr(key_begin, ends[i - begin] - key_begin);
+                entries[i] = { detail::key_prefix(keys[i]), uint32_t(i) };
+            }
+        });
+
+        // order of the entries of a range at the given depth, the prefixes hold the key bytes from there
+        auto const less_at = [&keys](size_t depth)
+        {
+            return [&keys, tail = depth + 8](sort_key_entry const &a, sort_key_entry const &b)
+            {
+                if (a.prefix != b.prefix)
+                    return a.prefix < b.prefix;
+
+                std::string_view const ka = keys[a.index];
+                std::string_view const kb = keys[b.index];
+                int const cmp = ka.size() > tail || kb.size() > tail
+                    ? ka.substr(std::min(tail, ka.size())).compare(kb.substr(std::min(tail, kb.size())))
+                    : int(ka.size() > kb.size()) - int(ka.size() < kb.size());
+
+                return cmp != 0 ? cmp < 0 : a.index < b.index;
+            };
+        };
+
+        size_t const oversized = std::max<size_t>(count / (size_t(threads) * 8), 1024);
+        std::vector<sort_key_entry> scratch(count);
+
+        // partitions a range by the first prefix byte that differs within it:
+        // buckets still oversized go to the next round, the others are sorted
+        auto const split = [&](sort_key_range const &range, std::vector<sort_key_range> &next)
+        {
+            auto const first = entries.begin() + range.begin;
+            auto const last = entries.begin() + range.end;
+            size_t depth = range.depth;
+
+            uint64_t differing = 0;
+            for (auto it = first; it != last; ++it)
+                differing |= it->prefix ^ first->prefix;
+
+            while (differing == 0)
+            {
+                // same 8 bytes everywhere: go on with the next 8, unless all the keys end here and are equal
+                bool const longer = std::any_of(first, last, [&](sort_key_entry const &e) { return keys[e.index].size() > depth + 8; });
+                if (!longer)
+                {
+                    std::sort(first, last, less_at(depth));
+                    return;
+                }
+
+                depth += 8;
+                for (auto it = first; it != last; ++it)
+                    it->prefix = detail::key_prefix(keys[it->index], depth);
+                for (auto it = first; it != last; ++it)
+                    differing |= it->prefix ^ first->prefix;
+            }
+
+            int shift = 56;
+            while (((differing >> shift) & 0xff) == 0)
+                shift -= 8;
+
+            size_t constexpr buckets_count = 256;
+            std::array<size_t, buckets_count + 1> offsets{};
+            for (auto it = first; it != last; ++it)
+                ++offsets[((it->prefix >> shift) & 0xff) + 1];
+            for (size_t b = 0; b < buckets_count; ++b)
+                offsets[b + 1] += offsets[b];
+
+            {
+                auto pos = offsets;
+                for (auto it = first; it != last; ++it)
+                    scratch[range.begin + pos[(it->prefix >> shift) & 0xff]++] = *it;
+                std::copy(scratch.begin() + range.begin, scratch.begin() + range.end, first);
+            }
+
+            for (size_t b = 0; b < buckets_count; ++b)
+            {
+                size_t const size = offsets[b + 1] - offsets[b];
+                if (size > oversized)
+                    next.push_back({ range.begin + offsets[b], range.begin + offsets[b + 1], depth });
+                else if (size > 1)
+                    std::sort(first + offsets[b], first + offsets[b + 1], less_at(depth));
+            }
+        };
+
+        // ranges are disjoint, so the ones of a round are split in parallel
+        std::vector<sort_key_range> ranges{ { 0, count, 0 } };
+        while (!ranges.empty())
+        {
+            std::vector<std::vector<sort_key_range>> next(threads);
+            std::atomic<size_t> next_range{ 0 };
+            auto const split_ranges = [&](unsigned t)
+            {
+                for (size_t r = next_range++; r < ranges.size(); r = next_range++)
+                    split(ranges[r], next[t]);
+            };
+
+            {
+                std::vector<std::thread> workers;
+                for (unsigned t = 1; t < threads && t < ranges.size(); ++t)
+                    workers.emplace_back(split_ranges, t);
+                split_ranges(0);
+                for (auto &w : workers)
+                    w.join();
+            }
+
+            ranges.clear();
+            for (auto const &n : next)
+                ranges.insert(ranges.end(), n.begin(), n.end());
+        }
+
+        std::vector<value_type> result;
+        result.reserve(count);
+        for (auto const &e : entries)
+            result.push_back(std::move(data[e.index]));
+
+        std::move(result.begin(), result.end(), data.begin());
+    }
+
+} // namespace cora
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace cora
+{
+    namespace detail
+    {
+        inline uint64_t next_tracked_version()
+        {
+            static std::atomic<uint64_t> counter{ 0 };
+            return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+    } // namespace detail
+
+    // Opt-in change tracking of a (typically reflected) member:
+    // every modification through modify(f) or assignment stamps the value with a new, process-wide unique version,
+    // so equal versions mean equal contents and serialized forms can be cached by version (see json_io::cached_writer).
+    // Copies keep the version of the original, moved-from objects get a new one.
+    //
+    // The value is only reachable as const outside of modify(f), so a tracked value nested in another one
+    // can only be changed from within the outer modify(f), which stamps the outer value as well.
+    template<typename T>
+    struct tracked
+    {
+        using value_type = T;
+
+        tracked()
+            : value_()
+            , version_(detail::next_tracked_version())
+        {
+        }
+
+        template<typename... Args, typename = std::enable_if_t<std::is_constructible_v<T, Args&&...>>>
+        explicit tracked(std::in_place_t, Args &&... args)
+            : value_(std::forward<Args>(args)...)
+            , version_(detail::next_tracked_version())
+        {
+        }
+
+        tracked(T const &value)
+            : value_(value)
+            , version_(detail::next_tracked_version())
+        {
+        }
+
+        tracked(T &&value)
+            : value_(std::move(value))
+            , version_(detail::next_tracked_version())
+        {
+        }
+
+        tracked(tracked const &) = default;
+        tracked &operator=(tracked const &) = default;
+
+        tracked(tracked &&other)
+            : value_(std::move(other.value_))
+            , version_(std::exchange(other.version_, detail::next_tracked_version()))
+        {
+        }
+
+        tracked &operator=(tracked &&other)
+        {
+            value_ = std::move(other.value_);
+            version_ = std::exchange(other.version_, detail::next_tracked_version());
+            return *this;
+        }
+
+        tracked &operator=(T const &value)
+        {
+            modify([&value](T &v) { v = value; });
+            return *this;
+        }
+
+        tracked &operator=(T &&value)
+        {
+            modify([&value](T &v) { v = std::move(value); });
+            return *this;
+        }
+
+        T const &get() const { return value_; }
+        T const &operator*() const { return value_; }
+        T const *operator->() const { return &value_; }
+
+        // f(T &) changes the value, which gets a new version once f returns or throws;
+        // f must not keep the reference, later changes through it would go unnoticed
+        template<typename F>
+        void modify(F &&f)
+        {
+            struct restamp
+            {
+                uint64_t &version;
+
+                ~restamp()
+                {
+                    version = detail::next_tracked_version();
+                }
+            } const guard{ version_ };
+
+            std::invoke(std::forward<F>(f), value_);
+        }
+
+        uint64_t version() const
+        {
+            return version_;
+        }
+
+    private:
+        T value_;
+        uint64_t version_;
+    };
+
+    template<typename T>
+    bool operator==(tracked<T> const &lhs, tracked<T> const &rhs)
+    {
+        return lhs.version() == rhs.version() || lhs.get() == rhs.get();
+    }
+
+    template<typename T>
+    bool operator!=(tracked<T> const &lhs, tracked<T> const &rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    template<typename T>
+    bool operator<(tracked<T> const &lhs, tracked<T> const &rhs)
+    {
+        return lhs.get() < rhs.get();
+    }
+
+namespace reflection
+{
+namespace traits
+{
+    template<typename T>
+    struct is_tracked : std::false_type {};
+
+    template<typename T>
+    struct is_tracked<cora::tracked<T>> : std::true_type {};
+
+} // namespace traits
+} // namespace reflection
+} // namespace cora
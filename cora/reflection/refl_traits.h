@@ -0,0 +1,77 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "cora/reflection/reflection.h"
+
+namespace cora
+{
+namespace reflection
+{
+namespace traits
+{
+    template<typename T>
+    using remove_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+    template<typename T>
+    struct is_optional : std::false_type {};
+
+    template<typename T>
+    struct is_optional<std::optional<T>> : std::true_type {};
+
+    // std::basic_string with any traits/allocator, e.g. std::pmr::string
+    template<typename T>
+    struct is_basic_string : std::false_type {};
+
+    template<typename Char, typename Traits, typename Alloc>
+    struct is_basic_string<std::basic_string<Char, Traits, Alloc>> : std::true_type {};
+
+    template<typename T>
+    struct is_basic_string_view : std::false_type {};
+
+    template<typename Char, typename Traits>
+    struct is_basic_string_view<std::basic_string_view<Char, Traits>> : std::true_type {};
+
+    template<typename T>
+    struct is_string : std::integral_constant<bool, is_basic_string<T>::value || is_basic_string_view<T>::value> {};
+
+    template<typename T, typename = void>
+    struct is_container : std::false_type {};
+
+    template<typename T>
+    struct is_container<T, std::void_t<
+            typename T::value_type,
+            decltype(std::declval<T const&>().begin()),
+            decltype(std::declval<T const&>().end()),
+            decltype(std::declval<T const&>().size())>>
+        : std::integral_constant<bool, !is_string<T>::value> {};
+
+    template<typename T, typename = void>
+    struct is_map : std::false_type {};
+
+    template<typename T>
+    struct is_map<T, std::void_t<typename T::key_type, typename T::mapped_type>>
+        : is_container<T> {};
+
+    template<typename T, typename = void>
+    struct has_reserve : std::false_type {};
+
+    template<typename T>
+    struct has_reserve<T, std::void_t<decltype(std::declval<T&>().reserve(std::size_t()))>> : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_resize : std::false_type {};
+
+    template<typename T>
+    struct has_resize<T, std::void_t<decltype(std::declval<T&>().resize(std::size_t()))>> : std::true_type {};
+
+    // REFL_ENTRY_TAG tags, as passed to the processors
+    template<typename Tag, typename... Tags>
+    struct has_tag : std::disjunction<std::is_same<Tag, Tags>...> {};
+
+} // namespace traits
+} // namespace reflection
+} // namespace cora
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace cora
+{
+namespace reflection
+{
+namespace traits
+{
+    template<typename T>
+    struct is_variant : std::false_type {};
+
+    template<typename... Types>
+    struct is_variant<std::variant<Types...>> : std::true_type {};
+
+} // namespace traits
+
+    namespace detail
+    {
+        template<typename F, size_t I>
+        decltype(auto) call_with_index(F &f)
+        {
+            return f(std::integral_constant<size_t, I>());
+        }
+
+        template<typename F, size_t... I>
+        decltype(auto) dispatch_index(size_t index, F &f, std::index_sequence<I...>)
+        {
+            using result_type = decltype(f(std::integral_constant<size_t, 0>()));
+            static constexpr result_type (*table[])(F &) = { &call_with_index<F, I>... };
+            return table[index](f);
+        }
+
+        template<typename F, size_t... I>
+        void for_each_index(F &f, std::index_sequence<I...>)
+        {
+            (f(std::integral_constant<size_t, I>()), ...);
+        }
+    } // namespace detail
+
+    // calls f(std::integral_constant<size_t, index>()) through a table of its instantiations for every alternative,
+    // so that a run-time index (e.g. a decoded type tag) selects the alternative with a single indirect call
+    // index must be less than std::variant_size_v<Variant>
+    template<typename Variant, typename F>
+    decltype(auto) visit_index(size_t index, F &&f)
+    {
+        return detail::dispatch_index(index, f, std::make_index_sequence<std::variant_size_v<Variant>>());
+    }
+
+    // calls f(std::integral_constant<size_t, I>()) for every alternative index I in order
+    template<typename Variant, typename F>
+    void for_each_alternative(F &&f)
+    {
+        detail::for_each_index(f, std::make_index_sequence<std::variant_size_v<Variant>>());
+    }
+
+} // namespace reflection
+} // namespace cora
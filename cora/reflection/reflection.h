@@ -1,5 +1,14 @@
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cora/reflection/refl_enum.h"
+
 namespace cora
 {
 namespace reflection
@@ -14,7 +23,7 @@ namespace reflection
         template<typename Processor>
         tag_applier(Processor &&proc)
         {
-            proc.enable_tag()
+            proc.enable_tag();
         }
     };
 
@@ -25,67 +34,305 @@ namespace reflection
     };
 
     // Tags const... tags: const is ***VERY*** important for the proper processor function selection, since adding "const" is considered as a cast
-    template<typename Proc, typename T, typename... Tags>
-    void apply_proc(Proc &&proc, T &&l, T &&r, Tags const... tags)
+    // l and r may differ in constness only, e.g. destination and source of a copy
+    template<typename Proc, typename L, typename R, typename... Tags>
+    void apply_proc(Proc &&proc, L &&l, R &&r, Tags const... tags)
     {
         if constexpr (std::is_base_of_v<cora::reflection::processor2, std::remove_reference_t<Proc>>) 
-            proc(std::forward<T>(l), std::forward<T>(r), tags...); 
+            proc(std::forward<L>(l), std::forward<R>(r), tags...);
         else 
-            proc(std::forward<T>(l), tags...);
+            proc(std::forward<L>(l), tags...);
+    }
+
+    // used as the only argument of refl_fields() to find it by ADL without implicit derived-to-base casts
+    template<typename T>
+    struct type_tag
+    {
+    };
+
+    // compile-time description of a single REFL_ENTRY
+    // tags are stored by value, so they must be literal types (usually empty structs)
+    template<typename Owner, typename Member, typename... Tags>
+    struct field_desc
+    {
+        using owner_type  = Owner;
+        using member_type = Member;
+
+        static constexpr bool is_reference = false;
+
+        Member Owner::* ptr;
+        char const *name;
+        std::tuple<Tags...> tags;
+
+        template<typename T>
+        constexpr decltype(auto) get(T &obj) const
+        {
+            return (obj.*ptr);
+        }
+    };
+
+    // entry without a member pointer: a reference member, a nested member such as pos.x or a REFL_ENTRY_EXPR,
+    // reached through a getter instead; Member is the declared type, a reference for reference members
+    template<typename Owner, typename Member, typename Getter, typename... Tags>
+    struct accessor_desc
+    {
+        using owner_type  = Owner;
+        using member_type = std::remove_reference_t<Member>;
+
+        // the object holds an address, not the value
+        static constexpr bool is_reference = std::is_reference_v<Member>;
+
+        Getter getter;
+        char const *name;
+        std::tuple<Tags...> tags;
+
+        template<typename T>
+        constexpr decltype(auto) get(T &obj) const
+        {
+            return getter(obj);
+        }
+    };
+
+    // REFL_CHAIN(base) entry, expanded into the base fields by all_fields()
+    template<typename Owner, typename Base>
+    struct chain_desc
+    {
+        using owner_type = Owner;
+        using base_type  = Base;
+    };
+
+    struct fields_begin
+    {
+    };
+
+    template<typename... Descs>
+    constexpr auto make_fields(fields_begin, Descs... descs)
+    {
+        return std::tuple<Descs...>(descs...);
+    }
+
+    template<typename Owner, typename Member, typename Class, typename... Tags>
+    constexpr auto make_field(Member Class::* ptr, char const *name, Tags const... tags)
+    {
+        static_assert(std::is_base_of_v<Class, Owner>, "REFL_ENTRY for a member of unrelated type");
+        return field_desc<Owner, Member, Tags...>{ ptr, name, std::tuple<Tags...>(tags...) };
+    }
+
+    template<typename Owner, typename Member, typename Getter, typename... Tags>
+    constexpr auto make_accessor(Getter getter, char const *name, Tags const... tags)
+    {
+        return accessor_desc<Owner, Member, Getter, Tags...>{ getter, name, std::tuple<Tags...>(tags...) };
+    }
+
+    // whether Pointer, called with Owner *, gives a data member pointer (see REFL_ENTRY_NAMED)
+    template<typename Pointer, typename Owner, typename = void>
+    struct is_member_pointer_probe
+        : std::false_type
+    {
+    };
+
+    template<typename Pointer, typename Owner>
+    struct is_member_pointer_probe<Pointer, Owner, std::enable_if_t<std::is_member_object_pointer_v<std::invoke_result_t<Pointer, Owner *>>>>
+        : std::true_type
+    {
+    };
+
+    // REFL_ENTRY: a field_desc if &type::entry is a data member pointer, an accessor_desc otherwise
+    template<typename Owner, typename Member, typename Pointer, typename Getter, typename... Tags>
+    constexpr auto make_entry(Pointer pointer, Getter getter, char const *name, Tags const... tags)
+    {
+        if constexpr (is_member_pointer_probe<Pointer, Owner>::value)
+            return make_field<Owner>(pointer(static_cast<Owner *>(nullptr)), name, tags...);
+        else
+            return make_accessor<Owner, Member>(getter, name, tags...);
+    }
+
+    template<typename Owner, typename Base>
+    constexpr auto make_chain()
+    {
+        static_assert(std::is_base_of_v<Base, Owner>, "REFL_CHAIN for non-base type");
+        static_assert(!std::is_same_v<Base, Owner>, "REFL_CHAIN for same type");
+        return chain_desc<Owner, Base>{};
+    }
+
+    namespace detail
+    {
+        template<typename T, typename = void>
+        struct has_fields : std::false_type {};
+
+        template<typename T>
+        struct has_fields<T, std::void_t<decltype(refl_fields(type_tag<T>()))>> : std::true_type {};
+
+        template<typename Desc>
+        struct is_chain : std::false_type {};
+
+        template<typename Owner, typename Base>
+        struct is_chain<chain_desc<Owner, Base>> : std::true_type {};
+    } // namespace detail
+
+    // true for types declared with REFL_INNER / REFL_STRUCT
+    template<typename T>
+    struct is_reflected : detail::has_fields<std::remove_cv_t<std::remove_reference_t<T>>> {};
+
+    template<typename T>
+    constexpr bool is_reflected_v = is_reflected<T>::value;
+
+    // REFL_ENTRY / REFL_CHAIN descriptors of T, exactly as they are written
+    template<typename T>
+    constexpr auto own_fields()
+    {
+        return refl_fields(type_tag<std::remove_cv_t<T>>());
+    }
+
+    template<typename T>
+    constexpr auto all_fields();
+
+    namespace detail
+    {
+        template<typename Desc>
+        constexpr auto expand_desc(Desc const &desc)
+        {
+            if constexpr (is_chain<Desc>::value)
+                return all_fields<typename Desc::base_type>();
+            else
+                return std::make_tuple(desc);
+        }
+
+        template<typename Fields, std::size_t... I>
+        constexpr auto expand_fields(Fields const &fields, std::index_sequence<I...>)
+        {
+            return std::tuple_cat(expand_desc(std::get<I>(fields))...);
+        }
+    } // namespace detail
+
+    // field descriptors of T with REFL_CHAIN bases expanded in place, i.e. in the reflect2 visiting order
+    template<typename T>
+    constexpr auto all_fields()
+    {
+        constexpr auto fields = own_fields<T>();
+        return detail::expand_fields(fields, std::make_index_sequence<std::tuple_size_v<decltype(fields)>>());
+    }
+
+    template<typename T>
+    using fields_t = decltype(all_fields<T>());
+
+    template<typename T>
+    constexpr std::size_t fields_count_v = std::tuple_size_v<fields_t<T>>;
+
+    template<typename T, std::size_t I>
+    using field_t = typename std::tuple_element_t<I, fields_t<T>>::member_type;
+
+    template<typename T, std::size_t I>
+    constexpr char const *field_name_v = std::get<I>(all_fields<T>()).name;
+
+    namespace detail
+    {
+        template<typename Func, typename Fields, std::size_t... I>
+        constexpr void for_each_desc(Func &&f, Fields const &fields, std::index_sequence<I...>)
+        {
+            (f(std::get<I>(fields)), ...);
+        }
+    } // namespace detail
+
+    // calls f(desc) for every field descriptor of T, fully unrolled
+    template<typename T, typename Func>
+    constexpr void for_each_field(Func &&f)
+    {
+        constexpr auto fields = all_fields<T>();
+        detail::for_each_desc(f, fields, std::make_index_sequence<fields_count_v<T>>());
+    }
+
+    // calls f(member, desc) for every field of obj, member constness follows obj
+    template<typename T, typename Func>
+    constexpr void for_each_field(T &obj, Func &&f)
+    {
+        for_each_field<std::remove_cv_t<T>>([&obj, &f](auto const &desc)
+        {
+            f(desc.get(obj), desc);
+        });
+    }
+
+    template<typename Proc, typename L, typename R, typename Desc>
+    void apply_field(Proc &&proc, L &lobj, R &robj, Desc const &desc)
+    {
+        std::apply([&](auto const &... tags)
+        {
+            apply_proc(proc, desc.get(lobj), desc.get(robj), desc.name, tags...);
+        }, desc.tags);
     }
 
 } // namespace reflection
 } // namespace cora
 
-template<typename processor, typename T>                               
-void reflect(processor && proc, T && object)
+namespace cora
 {
-    reflect2(std::forward<processor>(proc), std::forward<T>(object), std::forward<T>(object));
+namespace reflection
+{
+namespace detail
+{
+    // no implicit casts: both sides must be the same reflected type, up to constness
+    template<typename L, typename R>
+    using enable_reflect2_t = std::enable_if_t<
+        is_reflected_v<L> &&
+        std::is_same_v<std::remove_cv_t<std::remove_reference_t<L>>, std::remove_cv_t<std::remove_reference_t<R>>>>;
+} // namespace detail
+} // namespace reflection
+} // namespace cora
+
+// lhs and rhs keep their constness, so that processors get const members for const objects
+template<typename processor, typename L, typename R>
+cora::reflection::detail::enable_reflect2_t<L, R> reflect2(processor && proc, L && lhs, R && rhs)
+{
+    using type = std::remove_cv_t<std::remove_reference_t<L>>;
+    constexpr auto fields = cora::reflection::all_fields<type>();
+
+    std::apply([&](auto const &... desc)
+    {
+        (cora::reflection::apply_field(proc, lhs, rhs, desc), ...);
+    }, fields);
 }
 
-// to avoid implicit casts
 template<typename processor, typename T>
-void reflect2(processor && proc, T const &, T const &) = delete;
+void reflect(processor && proc, T && object)
+{
+    reflect2(std::forward<processor>(proc), std::forward<T>(object), std::forward<T>(object));
+}
 
 #define REFL_STRUCT_BODY(...)                           \
-void reflect2(processor && proc, __VA_ARGS__  const & lhs, __VA_ARGS__  const & rhs) \
+constexpr auto refl_fields(cora::reflection::type_tag<__VA_ARGS__>) \
 {                                                       \
     typedef __VA_ARGS__ type;                           \
-                                                        \
-    type& lobj = const_cast<type&>(lhs);/*small hack*/  \
-    type& robj = const_cast<type&>(rhs);/*small hack*/  \
-                                                        \
-    (void) proc; /*avoiding warning*/                   \
-    (void) lobj; /*avoiding warning*/                   \
-    (void) robj; /*avoiding warning*/                   
+    (void) sizeof(type); /*avoiding warning*/           \
+    return cora::reflection::make_fields(cora::reflection::fields_begin()
 
 
     // for using outside structure or class
 #define REFL_STRUCT(type)                               \
-template<class processor>                               \
     REFL_STRUCT_BODY(type)
 
 // for using inside structure or class
 #define REFL_INNER(type)                        \
-template<class processor>                       \
     friend REFL_STRUCT_BODY(type)
 
-/*
-#define REFL_ENTRY_NAMED(entry, name)           \
-    if constexpr (std::is_base_of_v<cora::reflection::processor2, std::remove_reference_t<processor>>) \
-        proc(lobj.entry, robj.entry, name); \
-    else \
-        proc(lobj.entry, name);
+// entry is a data member of type (or of a base), described by its member pointer,
+// or a reference member or a nested member such as pos.x, for which &type::entry is not a member pointer
+// and which is reached through a getter as with REFL_ENTRY_EXPR
+#define REFL_ENTRY_MEMBER_POINTER(entry) \
+    [](auto *obj) -> decltype(&std::remove_pointer_t<decltype(obj)>::entry) { return &std::remove_pointer_t<decltype(obj)>::entry; }
+#define REFL_ENTRY_GETTER(entry) \
+    [](auto &obj) -> auto & { return obj.entry; }
 
+#define REFL_ENTRY_NAMED(entry, name) \
+    , cora::reflection::make_entry<type, decltype(std::declval<type &>().entry)>(REFL_ENTRY_MEMBER_POINTER(entry), REFL_ENTRY_GETTER(entry), name)
 #define REFL_ENTRY_NAMED_WITH_TAG(entry, name, tag) \
-    if constexpr (std::is_base_of_v<cora::reflection::processor2, std::remove_reference_t<processor>>) \
-        proc(lobj.entry, robj.entry, name, tag); \
-    else \
-        proc(lobj.entry, name, tag);
-*/
+    , cora::reflection::make_entry<type, decltype(std::declval<type &>().entry)>(REFL_ENTRY_MEMBER_POINTER(entry), REFL_ENTRY_GETTER(entry), name, tag)
+
+// any expression of obj giving an lvalue, named explicitly
 
-#define REFL_ENTRY_NAMED(entry, name) cora::reflection::apply_proc(proc, lobj.entry, robj.entry, name);        
-#define REFL_ENTRY_NAMED_WITH_TAG(entry, name, tag) cora::reflection::apply_proc(proc, lobj.entry, robj.entry, name, tag);        
+#define REFL_ENTRY_EXPR(expr, name) \
+    , cora::reflection::make_accessor<type, decltype(std::declval<type &>().expr)>(REFL_ENTRY_GETTER(expr), name)
+#define REFL_ENTRY_EXPR_WITH_TAG(expr, name, tag) \
+    , cora::reflection::make_accessor<type, decltype(std::declval<type &>().expr)>(REFL_ENTRY_GETTER(expr), name, tag)
 
 
 #define REFL_ENTRY(entry)                       \
@@ -111,20 +358,18 @@ template<class processor>                       \
     REFL_ENTRY(entry4) 
 
 #define REFL_CHAIN(base)                        \
-    static_assert(std::is_base_of_v<base, type>, "REFL_CHAIN for non-base type"); \
-    static_assert(!std::is_same_v<base, type>, "REFL_CHAIN for same type"); \
-    reflect2(std::forward<processor>(proc), static_cast<base&>(lobj), static_cast<base&>(robj));
+    , cora::reflection::make_chain<type, base>()
 
 
 
-#define REFL_END() }
+#define REFL_END() ); }
 
 
 #define ENUM_DECL(name) \
     inline auto const &enum_string_match_detail(name const*)       \
     {                                                              \
         typedef name enum_type;                                    \
-        const static std::vector<std::pair<enum_type, std::string>> m = {
+        const static cora::reflection::enum_table<enum_type> m = {
 
 #define ENUM_DECL_INNER(name) friend ENUM_DECL(name)
 
@@ -2,46 +2,61 @@
 
 #include "cora/reflection/reflection.h"
 
-/*template<typename processor, typename T1, typename T2>
+#include <array>
+#include <tuple>
+
+/*template<typename T1, typename T2>
 REFL_STRUCT_BODY(std::pair<T1, T2>)
     REFL_ENTRY(first)
     REFL_ENTRY(second)
 REFL_END()*/
 
-template<size_t SIZE>
-struct reflect_helper
+namespace cora
+{
+namespace reflection
+{
+namespace detail
 {
+    template<typename T>
+    struct is_std_tuple : std::false_type {};
 
-    template<std::size_t I = 0, class processor, class tuple_t>
-    static typename std::enable_if<I == SIZE, void>::type reflect2_tuple(processor& /* proc */, tuple_t& /* lhs */, tuple_t& /* rhs */)
-    {
-    }
+    template<typename... Args>
+    struct is_std_tuple<std::tuple<Args...>> : std::true_type {};
 
-    template<std::size_t I = 0, class processor, class tuple_t>
-    static typename std::enable_if < I < SIZE, void>::type reflect2_tuple(processor& proc, tuple_t& lhs, tuple_t& rhs)
+    template<typename T>
+    struct is_std_array : std::false_type {};
+
+    template<typename Type, size_t Size>
+    struct is_std_array<std::array<Type, Size>> : std::true_type {};
+
+    template<typename T>
+    using remove_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+    template<class processor, class tuple_t, std::size_t... I>
+    void reflect2_tuple(processor& proc, tuple_t& lhs, tuple_t& rhs, std::index_sequence<I...>)
     {
-        cora::reflection::apply_proc(proc, std::get<I>(lhs), std::get<I>(rhs), std::to_string(I).c_str());
-        reflect2_tuple<I + 1>(proc, lhs, rhs);
+        (cora::reflection::apply_proc(proc, std::get<I>(lhs), std::get<I>(rhs), std::to_string(I).c_str()), ...);
     }
-};
 
-template<class processor, class ...Args>
-void reflect2(processor& proc, std::tuple<Args...> const& lhs, std::tuple<Args...> const& rhs)
-{
-    typedef std::tuple<Args...> type;
-    type& lobj = const_cast<type&>(lhs);/*small hack*/
-    type& robj = const_cast<type&>(rhs);/*small hack*/
+} // namespace detail
+} // namespace reflection
+} // namespace cora
 
-    reflect_helper<std::tuple_size<type>::value>::reflect2_tuple(proc, lobj, robj);
+template<class processor, class T>
+std::enable_if_t<cora::reflection::detail::is_std_tuple<cora::reflection::detail::remove_cvref_t<T>>::value> reflect2(processor&& proc, T&& lhs, T&& rhs)
+{
+    using type = std::remove_reference_t<T>;
+    cora::reflection::detail::reflect2_tuple(proc, static_cast<type&>(lhs), static_cast<type&>(rhs),
+        std::make_index_sequence<std::tuple_size_v<std::remove_cv_t<type>>>());
 }
 
-template<class processor, class Type, size_t Size>
-void reflect2(processor& proc, std::array<Type, Size> const& lhs, std::array<Type, Size> const& rhs)
+template<class processor, class T>
+std::enable_if_t<cora::reflection::detail::is_std_array<cora::reflection::detail::remove_cvref_t<T>>::value> reflect2(processor&& proc, T&& lhs, T&& rhs)
 {
-    using type = std::array<Type, Size>;
-    type& lobj = const_cast<type&>(lhs);/*small hack*/
-    type& robj = const_cast<type&>(rhs);/*small hack*/
+    using type = std::remove_reference_t<T>;
+    type& lobj = lhs;
+    type& robj = rhs;
 
-    for (size_t i = 0; i < Size; ++i)
+    for (size_t i = 0; i < std::tuple_size_v<std::remove_cv_t<type>>; ++i)
         cora::reflection::apply_proc(proc, lobj[i], robj[i], std::to_string(i).c_str());
 }
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cora/serialization/csv_io.h"
+#include "cora/serialization/json_io.h"
+
+namespace cora
+{
+    namespace detail
+    {
+        // bounded lock-free single producer single consumer queue
+        // slots are assigned in place, so pushing a copy of an object reuses the buffers of the one it replaces
+        template<typename T>
+        struct spsc_ring
+        {
+            explicit spsc_ring(size_t capacity)
+            {
+                size_t size = 2;
+                while (size < capacity)
+                    size *= 2;
+
+                slots_.resize(size);
+                mask_ = size - 1;
+            }
+
+            spsc_ring(spsc_ring const &) = delete;
+            spsc_ring &operator=(spsc_ring const &) = delete;
+
+            // producer side
+            template<typename U>
+            bool try_push(U &&value)
+            {
+                uint64_t const tail = tail_.load(std::memory_order_relaxed);
+                if (tail - cached_head_ > mask_)
+                {
+                    cached_head_ = head_.load(std::memory_order_acquire);
+                    if (tail - cached_head_ > mask_)
+                        return false;
+                }
+
+                slots_[size_t(tail & mask_)] = std::forward<U>(value);
+                tail_.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            // consumer side, the element stays valid until pop()
+            T const *front()
+            {
+                uint64_t const head = head_.load(std::memory_order_relaxed);
+                if (head == cached_tail_)
+                {
+                    cached_tail_ = tail_.load(std::memory_order_acquire);
+                    if (head == cached_tail_)
+                        return nullptr;
+                }
+                return &slots_[size_t(head & mask_)];
+            }
+
+            void pop()
+            {
+                head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            // consumer side, the number of objects pushed and popped so far
+            uint64_t pushed() const
+            {
+                return tail_.load(std::memory_order_acquire);
+            }
+
+            uint64_t popped() const
+            {
+                return head_.load(std::memory_order_relaxed);
+            }
+
+        private:
+            static constexpr size_t cache_line = 64;
+
+            std::vector<T> slots_;
+            uint64_t mask_;
+
+            alignas(cache_line) std::atomic<uint64_t> tail_{ 0 };
+            uint64_t cached_head_ = 0;
+
+            alignas(cache_line) std::atomic<uint64_t> head_{ 0 };
+            uint64_t cached_tail_ = 0;
+        };
+
+        // appends to a std::string without intermediate copies
+        struct string_append_buf
+            : std::streambuf
+        {
+            std::string *target = nullptr;
+
+        private:
+            int_type overflow(int_type ch) override
+            {
+                if (!traits_type::eq_int_type(ch, traits_type::eof()))
+                    target->push_back(traits_type::to_char_type(ch));
+                return traits_type::not_eof(ch);
+            }
+
+            std::streamsize xsputn(char const *s, std::streamsize n) override
+            {
+                target->append(s, size_t(n));
+                return n;
+            }
+        };
+
+        // std::ostream appending to the given string, copies start unbound
+        struct string_append_stream
+        {
+            string_append_stream() = default;
+
+            string_append_stream(string_append_stream const &)
+            {
+            }
+
+            std::ostream &bind(std::string &target)
+            {
+                buf_.target = &target;
+                return s_;
+            }
+
+        private:
+            string_append_buf buf_;
+            std::ostream s_{ &buf_ };
+        };
+
+    } // namespace detail
+
+    // one json document per line
+    struct json_line_serializer
+    {
+        template<typename T>
+        void operator()(std::string &out, T const &obj)
+        {
+            json_io::write_string(out, obj);
+            out += '\n';
+        }
+    };
+
+    // csv_io::write_csv_line, the title is up to the caller, e.g. csv_io::write_csv_title before the sink is created
+    struct csv_line_serializer
+    {
+        template<typename T>
+        void operator()(std::string &out, T const &obj)
+        {
+            size_t const bound = csv_io::line_size_bound(obj);
+            if (out.capacity() - out.size() < bound)
+                out.reserve(std::max(out.size() + bound, 2 * out.capacity()));
+
+            csv_io::write_csv_line(s_.bind(out), obj);
+        }
+
+    private:
+        detail::string_append_stream s_;
+    };
+
+    struct async_sink_options
+    {
+        size_t ring_capacity      = 1024;      // objects per producer
+        size_t block_size         = 1 << 20;   // bytes handed to the stream by a single write
+        size_t max_pending_blocks = 8;         // serialized blocks waiting for the writer before workers stall
+        size_t workers            = 1;         // serializing threads, producer i is served by worker i % workers
+        size_t max_producers      = 16;
+        std::chrono::microseconds idle_sleep{ 100 };
+    };
+
+    // Moves serialization and output of reflected objects off the calling thread:
+    //  - each producer owns a lock-free SPSC ring, push() costs a copy assignment into a ring slot
+    //  - worker threads serialize the objects into pooled buffers of about block_size bytes
+    //  - a writer thread writes the filled buffers to the stream and returns them to the pool
+    // Objects of one producer are written in the order they were pushed.
+    // Serializer is a callable void(std::string &out, T const &obj) appending obj to out, copied for each worker.
+    template<typename T, typename Serializer = json_line_serializer>
+    struct async_sink
+    {
+        struct producer
+        {
+            // false if the ring is full
+            template<typename U>
+            bool try_push(U &&obj)
+            {
+                return ring_->try_push(std::forward<U>(obj));
+            }
+
+            // waits while the ring is full
+            template<typename U>
+            void push(U &&obj)
+            {
+                while (!ring_->try_push(std::forward<U>(obj)))
+                    std::this_thread::yield();
+            }
+
+        private:
+            friend struct async_sink;
+
+            explicit producer(detail::spsc_ring<T> *ring)
+                : ring_(ring)
+            {
+            }
+
+            detail::spsc_ring<T> *ring_;
+        };
+
+        explicit async_sink(std::ostream &s, Serializer serializer = Serializer(), async_sink_options const &options = async_sink_options())
+            : s_(s)
+            , options_(options)
+            , acked_(std::max<size_t>(options.workers, 1), 0)
+        {
+            options_.workers = acked_.size();
+            rings_.resize(options_.max_producers);
+
+            for (size_t w = 0; w < options_.workers; ++w)
+                workers_.emplace_back([this, w, serializer] { worker_loop(w, serializer); });
+
+            writer_ = std::thread([this] { writer_loop(); });
+        }
+
+        async_sink(async_sink const &) = delete;
+        async_sink &operator=(async_sink const &) = delete;
+
+        // writes everything pushed so far; producers must not push concurrently with the destruction
+        ~async_sink()
+        {
+            stop_.store(true, std::memory_order_release);
+            for (auto &w : workers_)
+                w.join();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                workers_done_ = true;
+            }
+            writer_cv_.notify_one();
+            writer_.join();
+        }
+
+        // a producer is meant to be used by a single thread at a time
+        producer make_producer()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            size_t const idx = producers_count_.load(std::memory_order_relaxed);
+            if (idx == rings_.size())
+                throw std::length_error("async_sink: too many producers");
+
+            rings_[idx] = std::make_unique<detail::spsc_ring<T>>(options_.ring_capacity);
+            producers_count_.store(idx + 1, std::memory_order_release);
+            return producer(rings_[idx].get());
+        }
+
+        // waits until everything pushed before the call is written and the stream is flushed
+        // rethrows the first exception thrown by a serializer or the stream
+        void flush()
+        {
+            uint64_t const generation = flush_requested_.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushed_cv_.wait(lock, [this, generation] { return flushed_ >= generation; });
+
+            if (error_)
+                std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+
+    private:
+        void worker_loop(size_t worker, Serializer serializer)
+        {
+            std::string buffer = take_buffer();
+            size_t idle_rounds = 0;
+
+            // the flush generation being handled and the ring positions pushed before it was requested,
+            // it is acknowledged once they are consumed, however busy the rings stay
+            uint64_t pending = acked_[worker];
+            std::vector<uint64_t> targets;
+
+            for (;;)
+            {
+                // read before the ring positions: everything pushed before the flush call is below the positions taken afterwards
+                uint64_t const generation = flush_requested_.load(std::memory_order_acquire);
+                bool const stopping = stop_.load(std::memory_order_acquire);
+                size_t const producers = producers_count_.load(std::memory_order_acquire);
+
+                if (pending == acked_[worker] && generation != pending)
+                {
+                    pending = generation;
+                    targets.clear();
+                    for (size_t p = worker; p < producers; p += options_.workers)
+                        targets.push_back(rings_[p]->pushed());
+                }
+
+                bool busy = false;
+                for (size_t p = worker; p < producers; p += options_.workers)
+                    busy |= drain(*rings_[p], serializer, buffer);
+
+                if (pending != acked_[worker] && consumed(worker, targets))
+                    hand_off(buffer, worker, pending);
+
+                if (busy)
+                {
+                    idle_rounds = 0;
+                    continue;
+                }
+
+                if (stopping)
+                {
+                    hand_off(buffer, worker, generation);
+                    return;
+                }
+
+                if (++idle_rounds < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(options_.idle_sleep);
+            }
+        }
+
+        // serializes a batch of the ring objects, the batch limit keeps the other producers of the worker going
+        bool drain(detail::spsc_ring<T> &ring, Serializer &serializer, std::string &buffer)
+        {
+            size_t count = 0;
+            for (; count < options_.ring_capacity; ++count)
+            {
+                T const *obj = ring.front();
+                if (!obj)
+                    break;
+
+                // whatever a failed serializer appended is dropped, no partial lines reach the stream
+                size_t const size = buffer.size();
+                try
+                {
+                    serializer(buffer, *obj);
+                }
+                catch (...)
+                {
+                    buffer.resize(size);
+                    set_error(std::current_exception());
+                }
+                ring.pop();
+
+                if (buffer.size() >= options_.block_size)
+                    hand_off(buffer);
+            }
+            return count != 0;
+        }
+
+        // whether the rings of the worker are consumed up to the given positions
+        bool consumed(size_t worker, std::vector<uint64_t> const &targets) const
+        {
+            for (size_t i = 0; i < targets.size(); ++i)
+            {
+                if (rings_[worker + i * options_.workers]->popped() < targets[i])
+                    return false;
+            }
+            return true;
+        }
+
+        std::string take_buffer()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return take_buffer_locked();
+        }
+
+        std::string take_buffer_locked()
+        {
+            if (pool_.empty())
+            {
+                std::string buffer;
+                buffer.reserve(options_.block_size + options_.block_size / 4);
+                return buffer;
+            }
+
+            std::string buffer = std::move(pool_.back());
+            pool_.pop_back();
+            return buffer;
+        }
+
+        // passes the buffer to the writer and replaces it with an empty one
+        // acknowledging a flush generation, if given, happens atomically with it
+        void hand_off(std::string &buffer, size_t worker = size_t(-1), uint64_t generation = 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                space_cv_.wait(lock, [this] { return ready_.size() < options_.max_pending_blocks; });
+
+                if (!buffer.empty())
+                {
+                    ready_.push_back(std::move(buffer));
+                    buffer = take_buffer_locked();
+                }
+
+                if (worker != size_t(-1))
+                    acked_[worker] = generation;
+            }
+            writer_cv_.notify_one();
+        }
+
+        void writer_loop()
+        {
+            std::deque<std::string> blocks;
+            for (;;)
+            {
+                uint64_t generation;
+                bool done;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    writer_cv_.wait(lock, [this]
+                    {
+                        return !ready_.empty() || workers_done_ || acked_generation() > flushed_;
+                    });
+
+                    blocks.swap(ready_);
+                    generation = acked_generation();
+                    done = workers_done_;
+                }
+                space_cv_.notify_all();
+
+                try
+                {
+                    for (auto const &block : blocks)
+                        s_.write(block.data(), std::streamsize(block.size()));
+
+                    if (generation > flushed_ || done)
+                        s_.flush();
+                }
+                catch (...)
+                {
+                    set_error(std::current_exception());
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    for (auto &block : blocks)
+                    {
+                        block.clear();
+                        pool_.push_back(std::move(block));
+                    }
+                    flushed_ = std::max(flushed_, generation);
+                }
+                blocks.clear();
+                flushed_cv_.notify_all();
+
+                if (done)
+                    return;
+            }
+        }
+
+        // the latest flush generation all the workers have handed their data off for
+        uint64_t acked_generation() const
+        {
+            return *std::min_element(acked_.begin(), acked_.end());
+        }
+
+        void set_error(std::exception_ptr e)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = e;
+        }
+
+    private:
+        std::ostream &s_;
+        async_sink_options options_;
+
+        std::vector<std::unique_ptr<detail::spsc_ring<T>>> rings_;
+        std::atomic<size_t> producers_count_{ 0 };
+
+        std::atomic<bool> stop_{ false };
+        std::atomic<uint64_t> flush_requested_{ 0 };
+
+        // guarded by mutex_
+        std::mutex mutex_;
+        std::condition_variable writer_cv_;
+        std::condition_variable space_cv_;
+        std::condition_variable flushed_cv_;
+        std::deque<std::string> ready_;
+        std::vector<std::string> pool_;
+        std::vector<uint64_t> acked_;
+        uint64_t flushed_ = 0;
+        bool workers_done_ = false;
+        std::exception_ptr error_;
+
+        std::vector<std::thread> workers_;
+        std::thread writer_;
+    };
+
+} // namespace cora
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_instrumentation.h"
+#include "cora/reflection/refl_soa.h"
+#include "cora/reflection/refl_tracked.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_variant.h"
+
+namespace cora
+{
+namespace binary_io
+{
+    // Compact binary encoding of reflected objects for the same host (native byte order and layout):
+    //  - types whose memory is all value are copied as they are (see is_memcpy_v): arithmetic types, enums,
+    //    and arrays and reflected types made of them only, without padding bytes
+    //  - other reflected types: the fields in REFL_ENTRY order, without names
+    //  - strings and containers: uint32 count, then the elements (a single copy for contiguous trivially copyable ones)
+    //  - optionals: uint8 flag, then the value if set
+    //  - pairs and tuples: the elements one after another
+    //  - variants: uint8 index of the alternative, then the alternative
+    //  - soa_vector: uint32 count, then every column as a whole
+    // Both sides must use the same type, e.g. check cora::reflection::schema_fingerprint_v.
+
+    struct decode_error : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    using size_type = uint32_t;
+
+    namespace detail
+    {
+        template<typename T, typename = void>
+        struct is_tuple_like : std::false_type {};
+
+        template<typename T>
+        struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+        template<typename T>
+        struct is_std_array : std::false_type {};
+
+        template<typename T, size_t N>
+        struct is_std_array<std::array<T, N>> : std::true_type {};
+
+        template<typename T, typename = void>
+        struct has_data : std::false_type {};
+
+        template<typename T>
+        struct has_data<T, std::void_t<decltype(std::declval<T&>().data())>> : std::true_type {};
+
+        template<typename T>
+        constexpr bool is_pointer_like_v = std::is_pointer_v<T> || std::is_member_pointer_v<T>;
+
+        template<typename T>
+        constexpr bool is_memcpy();
+
+        template<typename T, size_t... I>
+        constexpr bool fields_are_memcpy(std::index_sequence<I...>)
+        {
+            using cora::reflection::field_t;
+            using fields = cora::reflection::fields_t<T>;
+            return (!std::tuple_element_t<I, fields>::is_reference && ...)
+                && (is_memcpy<field_t<T, I>>() && ...) && (sizeof(field_t<T, I>) + ... + size_t(0)) == sizeof(T);
+        }
+
+        // pointers, string views and types with reference members are trivially copyable too, but they hold addresses,
+        // which mean nothing in another process;
+        // padding bytes are uninitialized, copying them would leak memory contents and make equal objects encode differently
+        template<typename T>
+        constexpr bool is_memcpy()
+        {
+            if constexpr (!std::is_trivially_copyable_v<T> || is_pointer_like_v<T> || std::is_empty_v<T>
+                || cora::reflection::traits::is_basic_string_view<T>::value)
+                return false;
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+                return true;
+            else if constexpr (std::is_floating_point_v<T>)
+                return sizeof(T) <= sizeof(double); // long double has padding on x86
+            else if constexpr (std::is_array_v<T>)
+                return is_memcpy<std::remove_extent_t<T>>();
+            else if constexpr (is_std_array<T>::value)
+                return is_memcpy<typename T::value_type>();
+            else if constexpr (cora::reflection::is_reflected_v<T>)
+                return fields_are_memcpy<T>(std::make_index_sequence<cora::reflection::fields_count_v<T>>());
+            else
+            {
+                // the members are unknown, only the lack of padding can be checked
+                return std::has_unique_object_representations_v<T>;
+            }
+        }
+
+        template<typename T>
+        constexpr bool is_memcpy_v = is_memcpy<T>();
+
+        // resizable contiguous containers of memcpy elements, read with a single copy
+        template<typename T, typename = void>
+        struct is_bulk_readable : std::false_type {};
+
+        template<typename T>
+        struct is_bulk_readable<T, std::enable_if_t<cora::reflection::traits::is_container<T>::value>>
+            : std::bool_constant<cora::reflection::traits::has_resize<T>::value && has_data<T>::value
+                && is_memcpy_v<typename T::value_type>>
+        {
+        };
+
+        struct string_sink
+        {
+            explicit string_sink(std::string &out)
+                : out_(out)
+            {
+            }
+
+            void put(void const *data, size_t size)
+            {
+                out_.append(static_cast<char const *>(data), size);
+            }
+
+        private:
+            std::string &out_;
+        };
+
+        struct counting_sink
+        {
+            void put(void const *, size_t size)
+            {
+                this->size += size;
+            }
+
+            size_t size = 0;
+        };
+
+        struct memory_source
+        {
+            memory_source(char const *data, size_t size)
+                : pos_(data)
+                , end_(data + size)
+            {
+            }
+
+            void get(void *data, size_t size)
+            {
+                if (size > remaining())
+                    throw decode_error("binary_io: unexpected end of data");
+
+                if (size != 0)
+                    std::memcpy(data, pos_, size);
+                pos_ += size;
+            }
+
+            size_t remaining() const
+            {
+                return size_t(end_ - pos_);
+            }
+
+            char const *position() const
+            {
+                return pos_;
+            }
+
+        private:
+            char const *pos_;
+            char const *end_;
+        };
+
+    } // namespace detail
+
+    // T with the memory layout fast path: written and read with a single copy
+    template<typename T>
+    constexpr bool is_memcpy_v = detail::is_memcpy_v<T>;
+
+    template<typename Sink>
+    struct write_processor
+    {
+        explicit write_processor(Sink &sink)
+            : sink_(sink)
+        {
+        }
+
+        template<typename T>
+        void operator()(T const &v, char const *name, ...)
+        {
+            CORA_INSTRUMENT_FIELD(scope, name);
+            (void) name;
+            encode(v);
+        }
+
+        template<typename T>
+        void encode(T const &v)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (traits::is_tracked<T>::value)
+                encode(v.get());
+            else if constexpr (traits::is_soa_vector<T>::value)
+            {
+                put_size(v.size());
+                v.visit_columns([this](auto, auto const &column)
+                {
+                    sink_.put(column.data(), column.size() * sizeof(column[0]));
+                });
+            }
+            else if constexpr (detail::is_memcpy_v<T>)
+                sink_.put(&v, sizeof(T));
+            else if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect(*this, v);
+            else if constexpr (traits::is_optional<T>::value)
+            {
+                uint8_t const has_value = v ? 1 : 0;
+                sink_.put(&has_value, 1);
+                if (v)
+                    encode(*v);
+            }
+            else if constexpr (detail::is_std_array<T>::value)
+            {
+                for (auto const &elem : v)
+                    encode(elem);
+            }
+            else if constexpr (traits::is_container<T>::value || traits::is_string<T>::value)
+            {
+                using value_type = typename T::value_type;
+
+                put_size(v.size());
+                if constexpr (detail::has_data<T const>::value && detail::is_memcpy_v<value_type>)
+                    sink_.put(v.data(), v.size() * sizeof(value_type));
+                else
+                {
+                    // the cast turns proxies, as of std::vector<bool>, into values
+                    for (auto const &elem : v)
+                        encode(static_cast<value_type const &>(elem));
+                }
+            }
+            else if constexpr (detail::is_tuple_like<T>::value)
+                std::apply([this](auto const &... elems) { (encode(elems), ...); }, v);
+            else if constexpr (traits::is_variant<T>::value)
+            {
+                static_assert(std::variant_size_v<T> < 256, "too many alternatives");
+                if (v.valueless_by_exception())
+                    throw std::bad_variant_access();
+
+                uint8_t const index = uint8_t(v.index());
+                sink_.put(&index, 1);
+                cora::reflection::visit_index<T>(index, [this, &v](auto idx)
+                {
+                    encode(std::get<decltype(idx)::value>(v));
+                });
+            }
+            else if constexpr (std::is_same_v<T, std::monostate>)
+            {
+            }
+            else
+                static_assert(sizeof(T) == 0, "type has no binary encoding");
+        }
+
+    private:
+        void put_size(size_t size)
+        {
+            if (size > size_t(std::numeric_limits<size_type>::max()))
+                throw std::length_error("binary_io: container is too large");
+
+            size_type const count = size_type(size);
+            sink_.put(&count, sizeof(count));
+        }
+
+    private:
+        Sink &sink_;
+    };
+
+    template<typename Source>
+    struct read_processor
+    {
+        explicit read_processor(Source &source)
+            : source_(source)
+        {
+        }
+
+        template<typename T>
+        void operator()(T &v, char const *name, ...)
+        {
+            CORA_INSTRUMENT_FIELD(scope, name);
+            (void) name;
+            decode(v);
+        }
+
+        template<typename T>
+        void decode(T &v)
+        {
+            namespace traits = cora::reflection::traits;
+
+            if constexpr (traits::is_tracked<T>::value)
+                v.modify([this](auto &value) { decode(value); });
+            else if constexpr (traits::is_soa_vector<T>::value)
+            {
+                size_t const size = get_size();
+                if (size > source_.remaining())
+                    throw decode_error("binary_io: unexpected end of data");
+
+                v.resize(size);
+                v.visit_columns([this, &v](auto idx, auto const &)
+                {
+                    auto column = v.template column<decltype(idx)::value>();
+                    source_.get(column.data(), column.size() * sizeof(column[0]));
+                });
+            }
+            else if constexpr (detail::is_memcpy_v<T>)
+                source_.get(&v, sizeof(T));
+            else if constexpr (cora::reflection::is_reflected_v<T>)
+                reflect(*this, v);
+            else if constexpr (traits::is_optional<T>::value)
+            {
+                uint8_t has_value;
+                source_.get(&has_value, 1);
+                if (!has_value)
+                    v.reset();
+                else
+                {
+                    if (!v)
+                        v.emplace();
+                    decode(*v);
+                }
+            }
+            else if constexpr (detail::is_std_array<T>::value)
+            {
+                for (auto &elem : v)
+                    decode(elem);
+            }
+            else if constexpr (traits::is_string<T>::value || detail::is_bulk_readable<T>::value)
+            {
+                using value_type = typename T::value_type;
+
+                size_t const size = get_size();
+                if (size > source_.remaining() / sizeof(value_type))
+                    throw decode_error("binary_io: unexpected end of data");
+
+                v.resize(size);
+                source_.get(v.data(), size * sizeof(value_type));
+            }
+            else if constexpr (traits::is_map<T>::value)
+            {
+                size_t const size = get_size();
+                v.clear();
+                for (size_t i = 0; i < size; ++i)
+                {
+                    typename T::key_type key{};
+                    typename T::mapped_type value{};
+                    decode(key);
+                    decode(value);
+                    v.emplace(std::move(key), std::move(value));
+                }
+            }
+            else if constexpr (traits::is_container<T>::value)
+            {
+                size_t const size = get_size();
+                v.clear();
+                if constexpr (traits::has_reserve<T>::value)
+                    v.reserve(std::min(size, source_.remaining())); // every element takes at least a byte
+
+                for (size_t i = 0; i < size; ++i)
+                {
+                    typename T::value_type elem{};
+                    decode(elem);
+                    v.insert(v.end(), std::move(elem));
+                }
+            }
+            else if constexpr (detail::is_tuple_like<T>::value)
+                std::apply([this](auto &... elems) { (decode(elems), ...); }, v);
+            else if constexpr (traits::is_variant<T>::value)
+            {
+                uint8_t index;
+                source_.get(&index, 1);
+                if (index >= std::variant_size_v<T>)
+                    throw decode_error("binary_io: invalid variant index");
+
+                cora::reflection::visit_index<T>(index, [this, &v](auto idx)
+                {
+                    constexpr size_t alternative = decltype(idx)::value;
+                    if (v.index() != alternative)
+                        v.template emplace<alternative>();
+                    decode(std::get<alternative>(v));
+                });
+            }
+            else if constexpr (std::is_same_v<T, std::monostate>)
+            {
+            }
+            else
+                static_assert(sizeof(T) == 0, "type has no binary encoding");
+        }
+
+    private:
+        size_t get_size()
+        {
+            size_type count;
+            source_.get(&count, sizeof(count));
+            return count;
+        }
+
+    private:
+        Source &source_;
+    };
+
+    // appends the encoding of obj to out
+    template<typename T>
+    void write(std::string &out, T const &obj)
+    {
+        detail::string_sink sink(out);
+        write_processor<detail::string_sink> proc(sink);
+        proc.encode(obj);
+    }
+
+    // exact size of the encoding, e.g. for reserving network frame space;
+    // takes a walk over obj, but containers of memcpy types count at once
+    template<typename T>
+    size_t encoded_size(T const &obj)
+    {
+        detail::counting_sink sink;
+        write_processor<detail::counting_sink> proc(sink);
+        proc.encode(obj);
+        return sink.size;
+    }
+
+    template<typename T>
+    std::string data_to_string(T const &obj)
+    {
+        std::string out;
+        out.reserve(encoded_size(obj));
+        write(out, obj);
+        return out;
+    }
+
+    // returns the number of bytes consumed, throws decode_error if the data ends too early
+    template<typename T>
+    size_t read(char const *data, size_t size, T &obj)
+    {
+        detail::memory_source source(data, size);
+        read_processor<detail::memory_source> proc(source);
+        proc.decode(obj);
+        return size - source.remaining();
+    }
+
+    template<typename T>
+    void string_to_data(std::string_view s, T &obj)
+    {
+        if (read(s.data(), s.size(), obj) != s.size())
+            throw decode_error("binary_io: trailing data");
+    }
+
+} // namespace binary_io
+} // namespace cora
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <optional>
 #include <ostream>
+#include <streambuf>
 #include <string>
 #include <string_view>
 #include <sstream>
 
 #include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_instrumentation.h"
+#include "cora/reflection/refl_soa.h"
+#include "cora/reflection/refl_tracked.h"
+#include "cora/reflection/refl_traits.h"
+#include "cora/reflection/refl_variant.h"
 
 namespace cora
 {
@@ -23,6 +32,157 @@ namespace csv_io
             std::void_t<  decltype(std::declval<S&>() << std::declval<T>())  > >
             : std::true_type {};
 
+        // declared enums by name, the rest (and undeclared values) as numbers
+        template<typename T>
+        void write_value(std::ostream &s, T const &entry)
+        {
+            if constexpr (std::is_enum_v<T>)
+            {
+                if constexpr (cora::reflection::is_enum_declared_v<T>)
+                {
+                    if (auto name = cora::enum_to_string(entry))
+                    {
+                        s << *name;
+                        return;
+                    }
+                }
+
+                s << +static_cast<std::underlying_type_t<T>>(entry);
+            }
+            else
+                s << entry;
+        }
+
+        // streambuf that only counts the characters
+        struct counting_buf
+            : std::streambuf
+        {
+            size_t size = 0;
+
+        private:
+            int_type overflow(int_type ch) override
+            {
+                if (!traits_type::eq_int_type(ch, traits_type::eof()))
+                    ++size;
+                return traits_type::not_eof(ch);
+            }
+
+            std::streamsize xsputn(char const *, std::streamsize n) override
+            {
+                size += size_t(n);
+                return n;
+            }
+        };
+
+        // walks an object as csv_line_proc does, adding up the longest text it may write with the given floating point precision
+        struct csv_size_proc
+        {
+            explicit csv_size_proc(std::streamsize precision)
+                : precision_(precision)
+            {
+            }
+
+            template<typename T, typename... Tags>
+            void operator()(T const &entry, std::string_view, Tags const...)
+            {
+                add_entry(entry);
+            }
+
+            size_t size() const
+            {
+                return size_;
+            }
+
+        private:
+            template<typename T>
+            void add_entry(T const &entry)
+            {
+                if constexpr (cora::reflection::traits::is_tracked<T>::value)
+                    add_entry(entry.get());
+                else if constexpr (cora::reflection::traits::is_variant<T>::value)
+                {
+                    // the inactive alternatives are blank, counted at the size of default values
+                    add_entry(entry.index());
+                    cora::reflection::for_each_alternative<T>([this, &entry](auto idx)
+                    {
+                        using alternative = std::variant_alternative_t<decltype(idx)::value, T>;
+                        if constexpr (!std::is_same_v<alternative, std::monostate>)
+                        {
+                            if (entry.index() == decltype(idx)::value)
+                                add_entry(std::get<decltype(idx)::value>(entry));
+                            else
+                                add_entry(alternative());
+                        }
+                    });
+                }
+                else
+                    add_field(entry);
+            }
+
+            template<typename T>
+            void add_field(T const &entry)
+            {
+                if (!first_)
+                    ++size_;
+
+                first_ = false;
+
+                if constexpr (std::is_enum_v<T>)
+                {
+                    if constexpr (cora::reflection::is_enum_declared_v<T>)
+                    {
+                        if (auto name = cora::enum_to_string(entry))
+                        {
+                            size_ += name->size();
+                            return;
+                        }
+                    }
+
+                    size_ += max_digits<decltype(+std::underlying_type_t<T>())>();
+                }
+                else if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)
+                    size_ += 1;
+                else if constexpr (std::is_integral_v<T>)
+                    size_ += max_digits<T>();
+                else if constexpr (std::is_floating_point_v<T>)
+                {
+                    // sign, digits, point and exponent of the default (%g like) format
+                    size_t const exponent = std::numeric_limits<T>::max_exponent10 >= 1000 ? 6 : 5;
+                    size_ += size_t(std::max<std::streamsize>(precision_, 1)) + 2 + exponent;
+                }
+                else if constexpr (cora::reflection::traits::is_string<T>::value)
+                    size_ += entry.size();
+                else if constexpr (std::is_convertible_v<T, char const *>)
+                    size_ += std::strlen(entry);
+                else if constexpr (is_to_stream_writable<std::ostream, T>::value)
+                {
+                    // unknown formatting, measured by writing it
+                    counting_buf buf;
+                    std::ostream s(&buf);
+                    s.precision(precision_);
+                    s << entry;
+                    size_ += buf.size;
+                }
+                else
+                {
+                    csv_size_proc inner(precision_);
+                    reflect(inner, entry);
+                    size_ += inner.size();
+                }
+            }
+
+            template<typename T>
+            static constexpr size_t max_digits()
+            {
+                return size_t(std::numeric_limits<T>::digits10 + 1 + (std::is_signed_v<T> ? 1 : 0));
+            }
+
+        private:
+            std::streamsize precision_;
+            size_t size_ = 0;
+            bool first_ = true;
+        };
+
     } // namespace detail
 
     struct csv_line_proc
@@ -33,19 +193,49 @@ namespace csv_io
         {
         }
 
+        template<typename T, typename... Tags>
+        void operator()(T const &entry, std::string_view name, Tags const...)
+        {
+            CORA_INSTRUMENT_FIELD(scope, name);
+            CORA_INSTRUMENT_CODE(auto const start = s_.tellp();)
+
+            write_entry(entry, name);
+
+            CORA_INSTRUMENT_CODE(if (start != std::ostream::pos_type(-1)) scope.add_bytes(uint64_t(s_.tellp() - start));)
+        }
+
+    private:
+        template<typename T>
+        void write_entry(T const &entry, std::string_view name)
+        {
+            if constexpr (cora::reflection::traits::is_tracked<T>::value)
+                write_entry(entry.get(), name);
+            else if constexpr (cora::reflection::traits::is_variant<T>::value)
+                write_variant(entry, name);
+            else
+                write_field(entry, name);
+        }
+
         template<typename T>
-        void operator()(T const &entry, std::string_view name)
+        void write_field(T const &entry, std::string_view name)
         {
             if (!first_)
                 s_ << ",";
 
             first_ = false;
 
-            if constexpr (detail::is_to_stream_writable<std::ostream, T>::value)
+            if constexpr (std::is_enum_v<T>)
             {
                 if (title_prefix_)
                     s_ << "\"" << *title_prefix_ << name << "\"";
-                else
+                else if (!blank_)
+                    detail::write_value(s_, entry);
+            }
+            else if constexpr (detail::is_to_stream_writable<std::ostream, T>::value)
+            {
+                if (title_prefix_)
+                    s_ << "\"" << *title_prefix_ << name << "\"";
+                else if (!blank_)
                 {
                     s_ << entry;
                 }
@@ -61,14 +251,44 @@ namespace csv_io
                 }
 
                 csv_line_proc inner(s_, new_title_prefix);
+                inner.blank_ = blank_;
                 reflect(inner, entry);
             }
         }
 
-    private:
+        // a "<name>_type" column with the index of the active alternative, then the columns of every alternative
+        // as of a field named "<name>_<index>", blank for the inactive ones (std::monostate has none)
+        template<typename T>
+        void write_variant(T const &entry, std::string_view name)
+        {
+            std::string const type_name = std::string(name) + "_type";
+            write_entry(entry.index(), type_name);
+
+            cora::reflection::for_each_alternative<T>([this, &entry, name](auto idx)
+            {
+                constexpr size_t index = decltype(idx)::value;
+                using alternative = std::variant_alternative_t<index, T>;
+
+                if constexpr (!std::is_same_v<alternative, std::monostate>)
+                {
+                    std::string const alternative_name = std::string(name) + "_" + std::to_string(index);
+                    if (!title_prefix_ && !blank_ && entry.index() == index)
+                        write_entry(std::get<index>(entry), alternative_name);
+                    else
+                    {
+                        bool const blank = blank_;
+                        blank_ = true;
+                        write_entry(alternative(), alternative_name);
+                        blank_ = blank;
+                    }
+                }
+            });
+        }
+
         std::ostream &s_;
         bool first_ = true;
         std::optional<std::string> title_prefix_;
+        bool blank_ = false;    // columns of an inactive variant alternative, only the separators are written
     };
 
     template<typename T>
@@ -88,10 +308,19 @@ namespace csv_io
         s << std::endl;
     }
 
+    // the longest write_csv_line(s, data) may write, line end included, for a stream of the given precision and default flags
+    template<typename T>
+    size_t line_size_bound(T const &data, std::streamsize precision = 6)
+    {
+        detail::csv_size_proc proc(precision);
+        reflect(proc, data);
+        return proc.size() + 1;
+    }
+
     template<typename Container>
     void write_csv_file(std::ostream &s, Container const &data)
     {
-        using value_type = Container::value_type;
+        using value_type = typename Container::value_type;
 
         value_type dummy;
         write_csv_title(s, dummy);
@@ -100,5 +329,28 @@ namespace csv_io
             write_csv_line(s, e);  
     }
 
+    // the same output as for std::vector<T>, written straight from the columns without gathering rows
+    template<typename T>
+    void write_csv_file(std::ostream &s, cora::soa_vector<T> const &data)
+    {
+        auto const &names = cora::soa_vector<T>::column_names();
+        for (size_t i = 0; i < names.size(); ++i)
+            s << (i != 0 ? "," : "") << "\"" << names[i] << "\"";
+        s << std::endl;
+
+        for (size_t row = 0; row < data.size(); ++row)
+        {
+            data.visit_columns([&s, row](auto idx, auto const &column)
+            {
+                if (decltype(idx)::value != 0)
+                    s << ",";
+
+                detail::write_value(s, column[row]);
+            });
+            s << "\n";
+        }
+        s.flush();
+    }
+
 } // namespace csv_io
 } // namespace cora
\ No newline at end of file
@@ -1,3 +1,5 @@
+#pragma once
+
 //#define RAPIDJSON_HAS_STDSTRING 1
 
 #include <rapidjson/document.h>
@@ -5,13 +7,27 @@
 #include <rapidjson/ostreamwrapper.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
 #include <rapidjson/error/en.h>
 
 #include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_schema.h"
+#include "cora/reflection/refl_assign.h"
+#include "cora/reflection/refl_instrumentation.h"
+#include "cora/reflection/refl_intern.h"
+#include "cora/reflection/refl_soa.h"
+#include "cora/reflection/refl_tracked.h"
+#include "cora/reflection/refl_variant.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory_resource>
 #include <stack>
 #include <optional>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 namespace json_io
 {
@@ -24,6 +40,15 @@ struct parse_error : std::runtime_error
 using json_value_type = rapidjson::Document::ValueType;
 using std::string;
 
+// root member holding cora::reflection::schema_fingerprint_v of the written type
+// it is always the first member, so the reader checks it without a lookup
+constexpr char const* schema_key = "__schema";
+
+// std::variant is written as {"type": index of the active alternative, "value": the alternative},
+// without "value" for std::monostate
+constexpr char const* variant_type_key = "type";
+constexpr char const* variant_value_key = "value";
+
 namespace detail
 {
     struct json_read_processor;
@@ -31,34 +56,105 @@ namespace detail
     template<class Allocator = rapidjson::MemoryPoolAllocator<>>
     struct json_write_processor;
 
+    template<class Writer>
+    struct json_sax_write_processor;
+
+    struct tracked_cache;
+
+    struct json_size_processor;
+
     inline rapidjson::Document read_stream_doc(std::istream&);
     inline void write_stream_doc(std::ostream& s, rapidjson::Document& doc, bool pretty);
+    inline void write_string_doc(std::string& out, rapidjson::Document& doc);
+
+    template<class T>
+    rapidjson::Document write_doc(T const& obj, bool with_schema);
+
+    template<class T>
+    size_t size_bound(T const& obj, bool with_schema);
+
+    template<class T>
+    bool has_same_schema(json_value_type const& doc);
+
+    template<class T, class Processor>
+    void write_schema(Processor& proc);
+
+    template<class T>
+    void read_doc(json_value_type const& doc, T& obj, std::pmr::memory_resource* resource, cora::string_pool* pool);
 }
 
+// if the data was written by write_stream with_schema for the very same type,
+// the fields are matched by position instead of by name
 template<class T>
 void read_stream(std::istream& s, T& obj)
 {
     using namespace detail;
     auto doc = read_stream_doc(s);
-    json_read_processor proc(doc);
-    reflect(proc, obj);
+    read_doc(doc, obj, nullptr, nullptr);
 }
 
+// the fields tagged with cora::interned are decoded as views into pool, which must outlive obj
 template<class T>
-void write_stream(std::ostream& s, T const& obj, bool pretty)
+void read_stream(std::istream& s, T& obj, cora::string_pool& pool)
 {
     using namespace detail;
-    rapidjson::Document doc;
-    json_write_processor<> proc(doc);
-    reflect(proc, obj);
+    auto doc = read_stream_doc(s);
+    read_doc(doc, obj, nullptr, &pool);
+}
+
+// all std::pmr containers of obj, nested reflected types and optionals included, are allocated from resource,
+// so that the decoded object can be released at once with the resource
+template<class T>
+void read_stream(std::istream& s, T& obj, std::pmr::memory_resource* resource, cora::string_pool* pool = nullptr)
+{
+    using namespace detail;
+    auto doc = read_stream_doc(s);
+    cora::reflect_rebind_resource(obj, resource);
+    read_doc(doc, obj, resource, pool);
+}
+
+template<class T>
+void write_stream(std::ostream& s, T const& obj, bool pretty, bool with_schema = false)
+{
+    using namespace detail;
+    auto doc = write_doc(obj, with_schema);
     write_stream_doc(s, doc, pretty);
 }
 
+// size of the compact json of obj, or a bit more: exact but for floating point numbers, which are counted at their longest
+// e.g. for reserving an output buffer or network frame space before writing
+template<class T>
+size_t encoded_size_bound(T const& obj, bool with_schema = false)
+{
+    using namespace detail;
+    return size_bound(obj, with_schema);
+}
+
+// appends the compact json of obj to out, growing out at most once
+template<class T>
+void write_string(std::string& out, T const& obj, bool with_schema = false)
+{
+    using namespace detail;
+    size_t const bound = size_bound(obj, with_schema);
+    if(out.capacity() - out.size() < bound)
+        out.reserve(std::max(out.size() + bound, 2 * out.capacity()));
+
+    auto doc = write_doc(obj, with_schema);
+    write_string_doc(out, doc);
+}
+
 template<class T>
-std::string data_to_string(T const& obj, bool pretty = false)
+std::string data_to_string(T const& obj, bool pretty = false, bool with_schema = false)
 {
+    if(!pretty)
+    {
+        std::string out;
+        write_string(out, obj, with_schema);
+        return out;
+    }
+
     std::ostringstream ss;
-    write_stream(ss, obj, pretty);
+    write_stream(ss, obj, pretty, with_schema);
     return ss.str();
 }
 
@@ -69,6 +165,20 @@ void string_to_data(std::string const& s, T& obj)
     read_stream(ss, obj);
 }
 
+template<class T>
+void string_to_data(std::string const& s, T& obj, cora::string_pool& pool)
+{
+    std::istringstream ss(s);
+    read_stream(ss, obj, pool);
+}
+
+template<class T>
+void string_to_data(std::string const& s, T& obj, std::pmr::memory_resource* resource, cora::string_pool* pool = nullptr)
+{
+    std::istringstream ss(s);
+    read_stream(ss, obj, resource, pool);
+}
+
 }
 
 namespace json_io::detail
@@ -117,12 +227,13 @@ namespace traits
     template<class T, direction_t Direction>
     struct is_string_like;
 
+    // basic_string is checked explicitly for the strings with other allocators, e.g. std::pmr::string
     template<class T>
-    struct is_string_like<T, direction_t::read> : std::integral_constant<bool, std::is_convertible_v<string, T>>
+    struct is_string_like<T, direction_t::read> : std::integral_constant<bool, std::is_convertible_v<string, T> || cora::reflection::traits::is_basic_string<T>::value>
     {};
 
     template<class T>
-    struct is_string_like<T, direction_t::write> : std::integral_constant<bool, std::is_convertible_v<T, string>>
+    struct is_string_like<T, direction_t::write> : std::integral_constant<bool, std::is_convertible_v<T, string> || cora::reflection::traits::is_string<T>::value>
     {};
 
     template<class T>
@@ -171,8 +282,170 @@ namespace traits
 
     template<class Type>
     struct is_optional<std::optional<Type>> : std::integral_constant<bool, true> {};
+
+    template<class T, class Alloc, class... Args>
+    struct is_constructible_with_allocator : std::integral_constant<bool,
+        std::uses_allocator_v<T, Alloc> && std::is_constructible_v<T, Args..., Alloc const&>>
+    {};
+}
+
+// creates an element for the container so that it uses the container allocator:
+// allocator-aware types get it as the trailing constructor argument,
+// reflected types have their std::pmr members moved to the container memory resource
+template<class T, class Container, class... Args>
+T make_element(Container const& c, Args&&... args)
+{
+    using allocator_type = typename Container::allocator_type;
+
+    if constexpr(traits::is_constructible_with_allocator<T, allocator_type, Args...>::value)
+        return T(std::forward<Args>(args)..., c.get_allocator());
+    else if constexpr(cora::reflection::is_reflected_v<T> && cora::reflection::traits::has_polymorphic_allocator<Container>::value)
+    {
+        T val(std::forward<Args>(args)...);
+        cora::reflect_rebind_resource(val, c.get_allocator().resource());
+        return val;
+    }
+    else
+        return T(std::forward<Args>(args)...);
+}
+
+// rapidjson output stream that only counts the characters
+struct counting_stream
+{
+    typedef char Ch;
+
+    void Put(Ch)
+    {
+        ++size;
+    }
+
+    void Flush()
+    {
+    }
+
+    size_t size = 0;
+};
+
+// rapidjson output stream appending to a std::string
+struct string_output_stream
+{
+    typedef char Ch;
+
+    explicit string_output_stream(std::string& out)
+        : out_(out)
+    {
+    }
+
+    void Put(Ch c)
+    {
+        out_.push_back(c);
+    }
+
+    void Flush()
+    {
+    }
+
+private:
+    std::string& out_;
+};
+
+inline size_t encoded_size(json_value_type const& json)
+{
+    counting_stream s;
+    rapidjson::Writer<counting_stream> writer(s);
+    json.Accept(writer);
+    return s.size;
+}
+
+#ifdef CORA_ENABLE_INSTRUMENTATION
+
+// identifies a non-empty object or array, the storage stays the same when the value is moved
+inline void const* storage_of(json_value_type const& json)
+{
+    if(json.IsObject() && json.MemberCount() != 0)
+        return &*json.MemberBegin();
+    if(json.IsArray() && json.Size() != 0)
+        return &*json.Begin();
+    return nullptr;
+}
+
+// same as encoded_size(json), but takes the sizes already measured by the nested fields
+inline size_t encoded_size(json_value_type const& json, cora::instrumentation::field_scope const& scope)
+{
+    auto const* storage = storage_of(json);
+    if(!storage)
+        return encoded_size(json);
+
+    if(auto const* bytes = scope.nested_bytes(storage))
+        return size_t(*bytes);
+
+    // brackets and commas
+    size_t size = 1;
+    if(json.IsObject())
+    {
+        for(auto const& member : json.GetObject())
+            size += encoded_size(member.name) + 1 + encoded_size(member.value, scope) + 1;
+    }
+    else
+    {
+        for(auto const& elem : json.GetArray())
+            size += encoded_size(elem, scope) + 1;
+    }
+    return size;
+}
+
+// to be called after the field has been processed: the nested fields have measured their parts by then,
+// so every value is walked once, and outside of the time and allocations of the field
+inline void instrument_value(cora::instrumentation::field_scope& scope, json_value_type const& json)
+{
+    cora::instrumentation::overhead_scope overhead;
+
+    size_t const size = encoded_size(json, scope);
+    scope.add_bytes(size);
+    if(auto const* storage = storage_of(json))
+        scope.share_bytes(storage, size);
+
+    if(json.IsArray())
+        scope.add_elements(json.Size());
+    else if(json.IsObject())
+        scope.add_elements(json.MemberCount());
+}
+
+#endif // CORA_ENABLE_INSTRUMENTATION
+
+template<class T>
+void read_doc(json_value_type const& doc, T& obj, std::pmr::memory_resource* resource, cora::string_pool* pool)
+{
+    if(has_same_schema<T>(doc))
+    {
+        json_read_processor proc(doc, true, 1, resource, pool);
+        reflect(proc, obj);
+    }
+    else
+    {
+        json_read_processor proc(doc, false, 0, resource, pool);
+        reflect(proc, obj);
+    }
+}
+
+
+template<class T>
+bool has_same_schema(json_value_type const& doc)
+{
+    if(!doc.IsObject() || doc.MemberCount() == 0)
+        return false;
+
+    auto const& first = *doc.MemberBegin();
+    return strcmp(first.name.GetString(), schema_key) == 0
+        && first.value.Is<uint64_t>()
+        && first.value.Get<uint64_t>() == cora::reflection::schema_fingerprint_v<T>;
 }
 
+template<class T, class Processor>
+void write_schema(Processor& proc)
+{
+    proc(uint64_t(cora::reflection::schema_fingerprint_v<T>), schema_key);
+}
 
 rapidjson::Document read_stream_doc(std::istream& s)
 {
@@ -187,6 +460,24 @@ rapidjson::Document read_stream_doc(std::istream& s)
     return d;
 }
 
+template<class T>
+rapidjson::Document write_doc(T const& obj, bool with_schema)
+{
+    rapidjson::Document doc;
+    json_write_processor<> proc(doc);
+    if(with_schema)
+        write_schema<T>(proc);
+    reflect(proc, obj);
+    return doc;
+}
+
+void write_string_doc(std::string& out, rapidjson::Document& doc)
+{
+    string_output_stream s(out);
+    rapidjson::Writer<string_output_stream> writer(s);
+    doc.Accept(writer);
+}
+
 void write_stream_doc(std::ostream& s, rapidjson::Document& doc, bool pretty)
 {
     using namespace rapidjson;
@@ -208,24 +499,77 @@ struct json_read_processor
 {
     static constexpr traits::direction_t direction = traits::direction_t::read;
 
-    json_read_processor(json_value_type const& document)
+    // positional: the object members are expected in the REFL_ENTRY order starting from first_member,
+    // as written when the schema fingerprints of the writer and the reader match; the members are still checked by name
+    // resource: if set, used for the values of optionals, which cannot take it from an enclosing container
+    // pool: storage of the fields tagged with cora::interned
+    json_read_processor(json_value_type const& document, bool positional = false, rapidjson::SizeType first_member = 0,
+        std::pmr::memory_resource* resource = nullptr, cora::string_pool* pool = nullptr)
         : json_(&document)
+        , positional_(positional)
+        , next_member_(first_member)
+        , resource_(resource)
+        , pool_(pool)
     {
     }
 
-    template<class T>
+    // Intern: string views, map keys included, are decoded into the pool (cora::interned tag of the field)
+    template<bool Intern = false, class T>
     void process_value(T& v, json_value_type const& json)
     {
-        if constexpr(traits::is_optional<T>::value)
+        if constexpr(cora::reflection::traits::is_tracked<T>::value)
+            v.modify([this, &json](auto& value) { process_value<Intern>(value, json); });
+        else if constexpr(cora::reflection::traits::is_soa_vector<T>::value)
+        {
+            // same as std::vector<T>, the rows are scattered to the columns
+            assert(json.IsArray());
+            v.reserve(v.size() + json.Size());
+
+            typename T::value_type row{};
+            for(auto& array_json : json.GetArray())
+            {
+                process_value<Intern>(row, array_json);
+                v.push_back(row);
+            }
+        }
+        else if constexpr(traits::is_optional<T>::value)
         {
             if(json.IsNull())
                 v = T();
             else
             {
-                v = std::decay_t<decltype(*v)>();
-                process_value(*v, json);
+                v.emplace();
+                if(resource_)
+                    cora::detail::rebind_resource(*v, resource_);
+                process_value<Intern>(*v, json);
             }
         }
+        else if constexpr(cora::reflection::traits::is_variant<T>::value)
+        {
+            if(!json.IsObject())
+                throw parse_error("variant is not an object");
+
+            auto type = json.FindMember(variant_type_key);
+            if(type == json.MemberEnd() || !type->value.IsUint() || type->value.GetUint() >= std::variant_size_v<T>)
+                throw parse_error("variant has no valid type");
+
+            // the type selects the alternative through a jump table instead of trying them in turn
+            cora::reflection::visit_index<T>(type->value.GetUint(), [&](auto idx)
+            {
+                constexpr size_t index = decltype(idx)::value;
+                if(v.index() != index)
+                    v.template emplace<index>();
+
+                if constexpr(!std::is_same_v<std::variant_alternative_t<index, T>, std::monostate>)
+                {
+                    auto value = json.FindMember(variant_value_key);
+                    if(value == json.MemberEnd())
+                        throw parse_error("variant has no value");
+
+                    process_value<Intern>(std::get<index>(v), value->value);
+                }
+            });
+        }
         else if constexpr(traits::is_leaf_type<T, direction>::value)
         {
             if constexpr(std::is_integral_v<T>)
@@ -234,10 +578,23 @@ struct json_read_processor
                 assert(json.Is<decltype(v * 1)>());
                 v = json.Get<decltype(v * 1)>();
             }
+            else if constexpr(cora::reflection::traits::is_basic_string<T>::value)
+            {
+                // keeps the string allocator and buffer
+                assert(json.IsString());
+                v.assign(json.GetString(), json.GetStringLength());
+            }
+            else if constexpr(Intern && cora::reflection::traits::is_basic_string_view<T>::value)
+            {
+                assert(json.IsString());
+                v = intern(json);
+            }
             else if constexpr(traits::is_string_like<T, direction>::value)
             {
+                static_assert(!cora::reflection::traits::is_basic_string_view<T>::value,
+                    "a string_view would point into the parsed document, tag the field with cora::interned");
                 assert(json.IsString());
-                v = string(json.GetString());
+                v = string(json.GetString(), json.GetStringLength());
             }
             else
             {
@@ -248,36 +605,86 @@ struct json_read_processor
         else if constexpr(traits::is_json_map<T, direction>::value)
         {
             assert(json.IsObject());
+            using key_type = std::decay_t<typename T::value_type::first_type>;
+            using mapped_type = typename T::value_type::second_type;
+
             for(auto& m : json.GetObject())
             {
-                typename T::value_type::second_type val;
-                process_value(val, m.value);
-                v.emplace(string(m.name.GetString()), std::move(val));
+                auto key = make_key<Intern, key_type>(v, m.name);
+                auto val = make_element<mapped_type>(v);
+                process_value<Intern>(val, m.value);
+                v.emplace(std::move(key), std::move(val));
             }
         }
         else if constexpr(traits::is_json_array<T, direction>::value)
         {
             assert(json.IsArray());
+            if constexpr(cora::reflection::traits::has_reserve<T>::value)
+                v.reserve(v.size() + json.Size());
+
             for(auto& array_json : json.GetArray())
             {
-                typename T::value_type val;
-                process_value(val, array_json);
+                auto val = make_element<typename T::value_type>(v);
+                process_value<Intern>(val, array_json);
                 v.insert(v.end(), std::move(val));
             }
         }
+        else if constexpr(std::is_enum_v<T>)
+        {
+            using underlying_type = std::underlying_type_t<T>;
+
+            // declared enums are written by name, the rest (and undeclared values) as numbers
+            if constexpr(cora::reflection::is_enum_declared_v<T>)
+            {
+                if(json.IsString())
+                {
+                    auto value = cora::string_to_enum<T>(std::string_view(json.GetString(), json.GetStringLength()));
+                    if(!value)
+                        throw parse_error(string("unknown enum value: ") + json.GetString());
+
+                    v = *value;
+                    return;
+                }
+            }
+
+            underlying_type raw;
+            process_value(raw, json);
+            v = static_cast<T>(raw);
+        }
         else
         {
             assert(json.IsObject());
-            json_read_processor pc(json);
+            json_read_processor pc(json, positional_, 0, resource_, pool_);
             reflect(pc, v);
         }
     }
 
-    template<class T>
-    void operator()(T& v, const char* key)
+    template<class T, class... Tags>
+    void operator()(T& v, const char* key, Tags const...)
     {
+        constexpr bool intern = cora::reflection::traits::has_tag<cora::intern_tag, Tags...>::value;
         assert(get_current_json().IsObject());
         using current_value_type = T;
+        CORA_INSTRUMENT_FIELD(scope, key);
+        if(positional_)
+        {
+            // the fingerprint only says how the document was written, it may have been edited since:
+            // a member out of place switches the rest of the object to the lookup by name
+            if(next_member_ < get_current_json().MemberCount())
+            {
+                auto it = get_current_json().MemberBegin() + next_member_;
+                if(it->name.GetStringLength() == strlen(key) && memcmp(it->name.GetString(), key, it->name.GetStringLength()) == 0)
+                {
+                    ++next_member_;
+                    process_value<intern>(v, it->value);
+                    CORA_INSTRUMENT_CODE(instrument_value(scope, it->value);)
+                    return;
+                }
+            }
+
+            positional_ = false;
+        }
+
         auto it = get_current_json().FindMember(key);
         if(it == get_current_json().MemberEnd()) 
         {
@@ -285,7 +692,8 @@ struct json_read_processor
             return;
         }
 
-        process_value(v, it->value);
+        process_value<intern>(v, it->value);
+        CORA_INSTRUMENT_CODE(instrument_value(scope, it->value);)
     }
 
     const json_value_type& get_current_json() const
@@ -293,10 +701,210 @@ struct json_read_processor
         return *json_;
     }
 
+  private:
+    std::string_view intern(json_value_type const& json)
+    {
+        if(!pool_)
+            throw parse_error("reading a cora::interned field requires a cora::string_pool");
+
+        return pool_->intern(std::string_view(json.GetString(), json.GetStringLength()));
+    }
+
+    template<bool Intern, class Key, class Container>
+    Key make_key(Container const& c, json_value_type const& name)
+    {
+        if constexpr(Intern && cora::reflection::traits::is_basic_string_view<Key>::value)
+            return Key(intern(name));
+        else
+        {
+            static_assert(!cora::reflection::traits::is_basic_string_view<Key>::value,
+                "a string_view key would point into the parsed document, tag the map with cora::interned");
+            return make_element<Key>(c, name.GetString(), name.GetStringLength());
+        }
+    }
+
   private:
     const json_value_type* json_;
+    bool positional_;
+    rapidjson::SizeType next_member_;
+    std::pmr::memory_resource* resource_;
+    cora::string_pool* pool_;
 };
 
+// walks an object as json_write_processor does, adding up the size of the compact json it writes
+struct json_size_processor
+{
+    static constexpr traits::direction_t direction = traits::direction_t::write;
+
+    // rapidjson::Writer formats a double into a buffer of that size
+    static constexpr size_t max_double_size = 25;
+
+    template<class T>
+    void process_value(T const& v)
+    {
+        if constexpr(cora::reflection::traits::is_tracked<T>::value)
+            process_value(v.get());
+        else if constexpr(cora::reflection::traits::is_soa_vector<T>::value)
+        {
+            add_separators(v.size());
+            for(size_t i = 0; i < v.size(); ++i)
+                process_value(v.get(i));
+        }
+        else if constexpr(traits::is_optional<T>::value)
+        {
+            if(!v)
+                size_ += 4;
+            else
+                process_value(*v);
+        }
+        else if constexpr(cora::reflection::traits::is_variant<T>::value)
+        {
+            assert(!v.valueless_by_exception());
+            cora::reflection::visit_index<T>(v.index(), [&](auto idx)
+            {
+                constexpr size_t index = decltype(idx)::value;
+
+                size_ += 2;
+                add_string(variant_type_key, strlen(variant_type_key));
+                size_ += 1;
+                add_integer(unsigned(index));
+                if constexpr(!std::is_same_v<std::variant_alternative_t<index, T>, std::monostate>)
+                {
+                    size_ += 1;
+                    add_string(variant_value_key, strlen(variant_value_key));
+                    size_ += 1;
+                    process_value(std::get<index>(v));
+                }
+            });
+        }
+        else if constexpr(traits::is_leaf_type<T, direction>::value)
+        {
+            if constexpr(cora::reflection::traits::is_string<T>::value)
+                add_string(v.data(), v.size());
+            else if constexpr(traits::is_string_like<T, direction>::value)
+            {
+                string const str(v);
+                add_string(str.data(), str.size());
+            }
+            else if constexpr(std::is_integral_v<T>)
+            {
+                // same promotion as in json_write_processor
+                add_integer(v * 1);
+            }
+            else
+                size_ += max_double_size;
+        }
+        else if constexpr(traits::is_json_map<T, direction>::value)
+        {
+            add_separators(v.size());
+            for(auto& field : v)
+            {
+                process_value(field.first);
+                size_ += 1;
+                process_value(field.second);
+            }
+        }
+        else if constexpr(traits::is_json_array<T, direction>::value)
+        {
+            add_separators(v.size());
+            for(auto const& elem : v)
+                process_value(elem);
+        }
+        else if constexpr(std::is_enum_v<T>)
+        {
+            if constexpr(cora::reflection::is_enum_declared_v<T>)
+            {
+                if(auto name = cora::enum_to_string(v))
+                {
+                    add_string(name->data(), name->size());
+                    return;
+                }
+            }
+
+            process_value(static_cast<std::underlying_type_t<T>>(v));
+        }
+        else
+        {
+            json_size_processor inner;
+            reflect(inner, v);
+            size_ += inner.object_size();
+        }
+    }
+
+    template<class T>
+    void operator()(T const& v, const char* key, ...)
+    {
+        ++members_;
+        add_string(key, strlen(key));
+        size_ += 1;
+        process_value(v);
+    }
+
+    // the processed members along with the braces and commas around them
+    size_t object_size() const
+    {
+        return size_ + 2 + (members_ != 0 ? members_ - 1 : 0);
+    }
+
+private:
+    // brackets and commas of a container
+    void add_separators(size_t count)
+    {
+        size_ += 2 + (count != 0 ? count - 1 : 0);
+    }
+
+    // quoted and escaped as rapidjson::Writer does it
+    void add_string(char const* str, size_t length)
+    {
+        size_ += length + 2;
+        for(size_t i = 0; i < length; ++i)
+        {
+            unsigned char const c = static_cast<unsigned char>(str[i]);
+            if(c < 0x20)
+                size_ += (c == '\b' || c == '\t' || c == '\n' || c == '\f' || c == '\r') ? 1 : 5;
+            else if(c == '"' || c == '\\')
+                size_ += 1;
+        }
+    }
+
+    template<class T>
+    void add_integer(T v)
+    {
+        using unsigned_type = std::make_unsigned_t<T>;
+
+        unsigned_type abs = unsigned_type(v);
+        if constexpr(std::is_signed_v<T>)
+        {
+            if(v < 0)
+            {
+                size_ += 1;
+                abs = unsigned_type(0) - abs;
+            }
+        }
+
+        size_ += 1;
+        while(abs >= 10)
+        {
+            abs /= 10;
+            size_ += 1;
+        }
+    }
+
+private:
+    size_t size_ = 0;
+    size_t members_ = 0;
+};
+
+template<class T>
+size_t size_bound(T const& obj, bool with_schema)
+{
+    json_size_processor proc;
+    if(with_schema)
+        write_schema<T>(proc);
+    reflect(proc, obj);
+    return proc.object_size();
+}
+
 template<class Allocator>
 struct json_write_processor
 {
@@ -311,7 +919,20 @@ struct json_write_processor
     template<class T>
     void process_value(T const& v, json_value_type& json)
     {
-        if constexpr(traits::is_optional<T>::value)
+        if constexpr(cora::reflection::traits::is_tracked<T>::value)
+            process_value(v.get(), json);
+        else if constexpr(cora::reflection::traits::is_soa_vector<T>::value)
+        {
+            json.SetArray();
+            json.Reserve(rapidjson::SizeType(v.size()), get_alloc());
+            for(size_t i = 0; i < v.size(); ++i)
+            {
+                json_value_type val;
+                process_value(v.get(i), val);
+                json.PushBack(std::move(val), get_alloc());
+            }
+        }
+        else if constexpr(traits::is_optional<T>::value)
         {
             if(!v)
                 json.SetNull();
@@ -322,9 +943,33 @@ struct json_write_processor
                 json = std::move(val);
             }
         }
+        else if constexpr(cora::reflection::traits::is_variant<T>::value)
+        {
+            assert(!v.valueless_by_exception());
+            json.SetObject();
+            cora::reflection::visit_index<T>(v.index(), [&](auto idx)
+            {
+                constexpr size_t index = decltype(idx)::value;
+
+                json_value_type type_key, type;
+                type_key.SetString(variant_type_key, get_alloc());
+                type.SetUint(unsigned(index));
+                json.AddMember(std::move(type_key), std::move(type), get_alloc());
+
+                if constexpr(!std::is_same_v<std::variant_alternative_t<index, T>, std::monostate>)
+                {
+                    json_value_type value_key, value;
+                    value_key.SetString(variant_value_key, get_alloc());
+                    process_value(std::get<index>(v), value);
+                    json.AddMember(std::move(value_key), std::move(value), get_alloc());
+                }
+            });
+        }
         else if constexpr(traits::is_leaf_type<T, direction>::value)
         {
-            if constexpr(traits::is_string_like<T, direction>::value)
+            if constexpr(cora::reflection::traits::is_string<T>::value)
+                json.SetString(v.data(), rapidjson::SizeType(v.size()), get_alloc());
+            else if constexpr(traits::is_string_like<T, direction>::value)
                 json.SetString(string(v).c_str(), get_alloc());
             else if constexpr (std::is_integral_v<T>)
             {
@@ -358,6 +1003,20 @@ struct json_write_processor
                 json.PushBack(std::move(val), get_alloc());
             }
         }
+        else if constexpr(std::is_enum_v<T>)
+        {
+            if constexpr(cora::reflection::is_enum_declared_v<T>)
+            {
+                // names are owned by the static enum table, no need to copy them
+                if(auto name = cora::enum_to_string(v))
+                {
+                    json.SetString(name->data(), rapidjson::SizeType(name->size()));
+                    return;
+                }
+            }
+
+            process_value(static_cast<std::underlying_type_t<T>>(v), json);
+        }
         else
         {
             json.SetObject();
@@ -368,12 +1027,14 @@ struct json_write_processor
     }
 
     template<class T>
-    void operator()(T const& v, const char* key)
+    void operator()(T const& v, const char* key, ...)
     {
+        CORA_INSTRUMENT_FIELD(scope, key);
         json_value_type json;
         json_value_type json_key;
         json_key.SetString(key, get_alloc());
         process_value(v, json);
+        CORA_INSTRUMENT_CODE(instrument_value(scope, json);)
         get_current_json().AddMember(std::move(json_key), std::move(json), get_alloc());
     }
 
@@ -393,6 +1054,334 @@ private:
     std::stack<json_value_type*> values_stack_;
 };
 
+
+// serialized tracked values by version, along with the versions of the tracked values nested in them
+struct tracked_cache
+{
+    struct entry
+    {
+        string bytes;
+        std::vector<uint64_t> nested;
+        uint64_t pass = 0;
+    };
+
+    // marks the entry and everything nested in it as used
+    entry const* find(uint64_t version)
+    {
+        auto it = entries_.find(version);
+        if(it == entries_.end())
+            return nullptr;
+
+        mark_used(it->second);
+        return &it->second;
+    }
+
+    entry const& store(uint64_t version, string bytes, std::vector<uint64_t> nested)
+    {
+        auto& e = entries_[version];
+        e.bytes = std::move(bytes);
+        e.nested = std::move(nested);
+        e.pass = pass_;
+        return e;
+    }
+
+    // drops the entries not used since the previous call
+    void next_pass()
+    {
+        for(auto it = entries_.begin(); it != entries_.end();)
+        {
+            if(it->second.pass != pass_)
+                it = entries_.erase(it);
+            else
+                ++it;
+        }
+        ++pass_;
+    }
+
+    size_t size() const
+    {
+        return entries_.size();
+    }
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for(auto const& e : entries_)
+            total += e.second.bytes.size();
+        return total;
+    }
+
+    void clear()
+    {
+        entries_.clear();
+    }
+
+private:
+    void mark_used(entry& e)
+    {
+        if(e.pass == pass_)
+            return;
+
+        e.pass = pass_;
+        for(auto version : e.nested)
+        {
+            auto it = entries_.find(version);
+            if(it != entries_.end())
+                mark_used(it->second);
+        }
+    }
+
+private:
+    std::unordered_map<uint64_t, entry> entries_;
+    uint64_t pass_ = 1;
+};
+
+// streams the same json as json_write_processor without building a document;
+// with a cache, cora::tracked values are serialized once per version and then spliced in as raw json
+template<class Writer>
+struct json_sax_write_processor
+{
+    static constexpr traits::direction_t direction = traits::direction_t::write;
+
+    explicit json_sax_write_processor(Writer& writer, tracked_cache* cache = nullptr, std::vector<uint64_t>* nested = nullptr)
+        : writer_(writer)
+        , cache_(cache)
+        , nested_(nested)
+    {
+    }
+
+    template<class T>
+    void process_value(T const& v)
+    {
+        if constexpr(cora::reflection::traits::is_tracked<T>::value)
+            process_tracked(v);
+        else if constexpr(cora::reflection::traits::is_soa_vector<T>::value)
+        {
+            writer_.StartArray();
+            for(size_t i = 0; i < v.size(); ++i)
+                process_value(v.get(i));
+            writer_.EndArray();
+        }
+        else if constexpr(traits::is_optional<T>::value)
+        {
+            if(!v)
+                writer_.Null();
+            else
+                process_value(*v);
+        }
+        else if constexpr(cora::reflection::traits::is_variant<T>::value)
+        {
+            assert(!v.valueless_by_exception());
+            writer_.StartObject();
+            cora::reflection::visit_index<T>(v.index(), [&](auto idx)
+            {
+                constexpr size_t index = decltype(idx)::value;
+
+                writer_.Key(variant_type_key);
+                writer_.Uint(unsigned(index));
+                if constexpr(!std::is_same_v<std::variant_alternative_t<index, T>, std::monostate>)
+                {
+                    writer_.Key(variant_value_key);
+                    process_value(std::get<index>(v));
+                }
+            });
+            writer_.EndObject();
+        }
+        else if constexpr(traits::is_leaf_type<T, direction>::value)
+        {
+            if constexpr(traits::is_string_like<T, direction>::value)
+                write_string(v, false);
+            else if constexpr (std::is_integral_v<T>)
+            {
+                // same promotion as in json_write_processor
+                write_integer(v * 1);
+            }
+            else
+                writer_.Double(double(v));
+        }
+        else if constexpr(traits::is_json_map<T, direction>::value)
+        {
+            writer_.StartObject();
+            for(auto& field : v)
+            {
+                write_string(field.first, true);
+                process_value(field.second);
+            }
+            writer_.EndObject();
+        }
+        else if constexpr(traits::is_json_array<T, direction>::value)
+        {
+            writer_.StartArray();
+            for(auto const& elem : v)
+                process_value(elem);
+            writer_.EndArray();
+        }
+        else if constexpr(std::is_enum_v<T>)
+        {
+            if constexpr(cora::reflection::is_enum_declared_v<T>)
+            {
+                if(auto name = cora::enum_to_string(v))
+                {
+                    writer_.String(name->data(), rapidjson::SizeType(name->size()));
+                    return;
+                }
+            }
+
+            process_value(static_cast<std::underlying_type_t<T>>(v));
+        }
+        else
+        {
+            writer_.StartObject();
+            reflect(*this, v);
+            writer_.EndObject();
+        }
+    }
+
+    template<class T>
+    void operator()(T const& v, const char* key, ...)
+    {
+        CORA_INSTRUMENT_FIELD(scope, key);
+        writer_.Key(key);
+        process_value(v);
+    }
+
+private:
+    template<class T>
+    void process_tracked(T const& v)
+    {
+        if(!cache_)
+        {
+            process_value(v.get());
+            return;
+        }
+
+        if(nested_)
+            nested_->push_back(v.version());
+
+        auto const* e = cache_->find(v.version());
+        if(!e)
+        {
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            std::vector<uint64_t> nested;
+            json_sax_write_processor<rapidjson::Writer<rapidjson::StringBuffer>> inner(writer, cache_, &nested);
+            inner.process_value(v.get());
+            e = &cache_->store(v.version(), string(buffer.GetString(), buffer.GetSize()), std::move(nested));
+        }
+
+        writer_.RawValue(e->bytes.data(), e->bytes.size(), raw_type<typename T::value_type>());
+    }
+
+    // only matters for the writer consistency checks
+    template<class T>
+    static constexpr rapidjson::Type raw_type()
+    {
+        if constexpr(traits::is_optional<T>::value)
+            return raw_type<typename T::value_type>();
+        else if constexpr(traits::is_string_like<T, direction>::value)
+            return rapidjson::kStringType;
+        else if constexpr(traits::is_leaf_type<T, direction>::value)
+            return rapidjson::kNumberType;
+        else if constexpr(traits::is_json_array<T, direction>::value)
+            return rapidjson::kArrayType;
+        else if constexpr(std::is_enum_v<T>)
+            return cora::reflection::is_enum_declared_v<T> ? rapidjson::kStringType : rapidjson::kNumberType;
+        else
+            return rapidjson::kObjectType;
+    }
+
+    template<class T>
+    void write_string(T const& v, bool key)
+    {
+        if constexpr(cora::reflection::traits::is_string<T>::value)
+        {
+            if(key)
+                writer_.Key(v.data(), rapidjson::SizeType(v.size()));
+            else
+                writer_.String(v.data(), rapidjson::SizeType(v.size()));
+        }
+        else
+        {
+            string const str(v);
+            if(key)
+                writer_.Key(str.c_str());
+            else
+                writer_.String(str.c_str());
+        }
+    }
+
+    template<class T>
+    void write_integer(T v)
+    {
+        if constexpr(std::is_same_v<T, int>)
+            writer_.Int(v);
+        else if constexpr(std::is_same_v<T, unsigned>)
+            writer_.Uint(v);
+        else if constexpr(std::is_signed_v<T>)
+            writer_.Int64(int64_t(v));
+        else
+            writer_.Uint64(uint64_t(v));
+    }
+
+private:
+    Writer& writer_;
+    tracked_cache* cache_;
+    std::vector<uint64_t>* nested_;
+};
+
 }
 
+namespace json_io
+{
+
+// Writes the same json as write_stream(s, obj, false), keeping the serialized form of every cora::tracked value:
+// while a tracked value keeps its version, its cached bytes are copied to the output instead of serializing it again,
+// so publishing a large object after a small change costs the serialization of the change plus a copy of the rest.
+// Cached values not used by a write are dropped after it.
+struct cached_writer
+{
+    template<class T>
+    void write_stream(std::ostream& s, T const& obj)
+    {
+        rapidjson::OStreamWrapper osw(s);
+        write(osw, obj);
+    }
+
+    template<class T>
+    std::string data_to_string(T const& obj)
+    {
+        rapidjson::StringBuffer buffer;
+        write(buffer, obj);
+        return string(buffer.GetString(), buffer.GetSize());
+    }
 
+    size_t cached_values() const
+    {
+        return cache_.size();
+    }
+
+    size_t cached_bytes() const
+    {
+        return cache_.bytes();
+    }
+
+    void clear()
+    {
+        cache_.clear();
+    }
+
+private:
+    template<class Stream, class T>
+    void write(Stream& s, T const& obj)
+    {
+        rapidjson::Writer<Stream> writer(s);
+        detail::json_sax_write_processor<rapidjson::Writer<Stream>> proc(writer, &cache_);
+        proc.process_value(obj);
+        cache_.next_pass();
+    }
+
+private:
+    detail::tracked_cache cache_;
+};
+
+}
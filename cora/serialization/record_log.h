@@ -0,0 +1,821 @@
+#pragma once
+
+// Append-only log of reflected records with random access, e.g. for recorded sessions.
+//
+// Records are encoded with binary_io and grouped into blocks that are compressed independently,
+// an index of the blocks is written at the end:
+//
+//  header:  magic "CORALOG1", schema fingerprint of the record type, codec
+//  blocks:  compressed [record 0][record 1]...[uint32 end offset of every record]
+//  index:   binary_io encoded std::vector<record_log_block>: file offset, sizes, number of the first record,
+//           records count and the min/max sort key (see refl_sort_key.h) of the key field of its records
+//  footer:  index offset and size, records count, magic "CORAIDX1"
+//
+// so a reader gets to record N or to the blocks of a key range with one seek and one block decompression each,
+// and decompresses the blocks of a range in parallel.
+// Byte order is native, as for binary_io.
+//
+// Codecs: a built-in LZ77 codec (LZ4-like byte format, no dependencies) and zlib,
+// available when CORA_RECORD_LOG_ZLIB is defined and the program links with -lz.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(CORA_RECORD_LOG_ZLIB) && __has_include(<zlib.h>)
+#include <zlib.h>
+#define CORA_RECORD_LOG_HAS_ZLIB 1
+#endif
+
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_schema.h"
+#include "cora/reflection/refl_sort_key.h"
+#include "cora/serialization/binary_io.h"
+
+namespace cora
+{
+    // malformed or truncated log, stream failures
+    struct record_log_error : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    enum class record_log_codec : uint32_t
+    {
+        none = 0,
+        lz   = 1,
+        zlib = 2,
+    };
+
+    struct record_log_options
+    {
+        record_log_codec codec = record_log_codec::lz;
+        size_t block_records = 4096;        // a block is closed when it has this many records
+        size_t block_bytes = 256 * 1024;    // or this many encoded bytes, whichever comes first
+        int zlib_level = 1;
+    };
+
+    // an entry of the block index
+    struct record_log_block
+    {
+        uint64_t offset = 0;            // from the start of the log
+        uint64_t first_record = 0;
+        uint32_t records_count = 0;
+        uint32_t compressed_size = 0;
+        uint32_t raw_size = 0;
+        std::string min_key;            // sort keys, empty if the log has no key
+        std::string max_key;
+
+        REFL_INNER(record_log_block)
+            REFL_ENTRY(offset)
+            REFL_ENTRY(first_record)
+            REFL_ENTRY(records_count)
+            REFL_ENTRY(compressed_size)
+            REFL_ENTRY(raw_size)
+            REFL_ENTRY(min_key)
+            REFL_ENTRY(max_key)
+        REFL_END()
+    };
+
+    namespace detail
+    {
+        constexpr uint64_t record_log_magic = 0x31474f4c41524f43ull;        // "CORALOG1"
+        constexpr uint64_t record_log_index_magic = 0x3158444941524f43ull;  // "CORAIDX1"
+        constexpr uint32_t record_log_has_key = 1;
+
+        struct record_log_header
+        {
+            uint64_t magic;
+            uint64_t fingerprint;
+            uint32_t codec;
+            uint32_t flags;
+
+            REFL_INNER(record_log_header)
+                REFL_ENTRY(magic)
+                REFL_ENTRY(fingerprint)
+                REFL_ENTRY(codec)
+                REFL_ENTRY(flags)
+            REFL_END()
+        };
+
+        struct record_log_footer
+        {
+            uint64_t index_offset;
+            uint64_t index_size;
+            uint64_t records_count;
+            uint64_t magic;
+
+            REFL_INNER(record_log_footer)
+                REFL_ENTRY(index_offset)
+                REFL_ENTRY(index_size)
+                REFL_ENTRY(records_count)
+                REFL_ENTRY(magic)
+            REFL_END()
+        };
+
+        // LZ77 with an LZ4-like byte format: sequences of
+        //   token (literals count << 4 | match length - 4), literals count extension, literals,
+        //   uint16 little-endian match offset, match length extension
+        // a count of 15 in the token is continued by bytes added up until one is less than 255;
+        // the last sequence may have literals only and ends the input
+        constexpr size_t lz_min_match = 4;
+        constexpr size_t lz_max_offset = 65535;
+        constexpr unsigned lz_hash_bits = 14;
+
+        inline uint32_t lz_load32(char const *p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline void lz_put_count(std::string &out, size_t count)
+        {
+            for (; count >= 255; count -= 255)
+                out.push_back(char(255));
+            out.push_back(char(count));
+        }
+
+        // match_size is 0 for the closing literals
+        inline void lz_put_sequence(std::string &out, char const *literals, size_t literals_size, size_t offset, size_t match_size)
+        {
+            size_t const match_code = match_size != 0 ? match_size - lz_min_match : 0;
+            out.push_back(char((std::min<size_t>(literals_size, 15) << 4) | std::min<size_t>(match_code, 15)));
+            if (literals_size >= 15)
+                lz_put_count(out, literals_size - 15);
+            out.append(literals, literals_size);
+
+            if (match_size != 0)
+            {
+                out.push_back(char(offset & 0xff));
+                out.push_back(char(offset >> 8));
+                if (match_code >= 15)
+                    lz_put_count(out, match_code - 15);
+            }
+        }
+
+        // appends the compressed data to out, size must fit uint32_t
+        inline void lz_compress(char const *src, size_t size, std::string &out)
+        {
+            // position + 1 of the last occurrence of every hashed 4-byte sequence
+            std::vector<uint32_t> table(size_t(1) << lz_hash_bits, 0);
+
+            size_t anchor = 0;
+            size_t pos = 0;
+            size_t misses = 0;
+            while (pos + lz_min_match <= size)
+            {
+                uint32_t const sequence = lz_load32(src + pos);
+                uint32_t &slot = table[(sequence * 2654435761u) >> (32 - lz_hash_bits)];
+                size_t const candidate = slot;
+                slot = uint32_t(pos + 1);
+
+                if (candidate != 0 && pos + 1 - candidate <= lz_max_offset && lz_load32(src + candidate - 1) == sequence)
+                {
+                    size_t const match = candidate - 1;
+                    size_t length = lz_min_match;
+                    while (pos + length < size && src[match + length] == src[pos + length])
+                        ++length;
+
+                    lz_put_sequence(out, src + anchor, pos - anchor, pos - match, length);
+                    pos += length;
+                    anchor = pos;
+                    misses = 0;
+                }
+                else
+                    pos += 1 + (misses++ >> 5); // steps grow over incompressible data
+            }
+
+            if (anchor < size)
+                lz_put_sequence(out, src + anchor, size - anchor, 0, 0);
+        }
+
+        // dst_size is the exact decompressed size
+        inline void lz_decompress(char const *src, size_t size, char *dst, size_t dst_size)
+        {
+            auto const corrupt = [] { return record_log_error("record_log: corrupt lz block"); };
+
+            char const *ip = src;
+            char const *const end = src + size;
+            size_t op = 0;
+
+            auto const read_count = [&](size_t count)
+            {
+                if (count == 15)
+                {
+                    unsigned char b;
+                    do
+                    {
+                        if (ip == end)
+                            throw corrupt();
+                        b = static_cast<unsigned char>(*ip++);
+                        count += b;
+                    } while (b == 255);
+                }
+                return count;
+            };
+
+            while (ip != end)
+            {
+                unsigned const token = static_cast<unsigned char>(*ip++);
+
+                size_t const literals = read_count(token >> 4);
+                if (literals > size_t(end - ip) || literals > dst_size - op)
+                    throw corrupt();
+                std::memcpy(dst + op, ip, literals);
+                ip += literals;
+                op += literals;
+
+                if (ip == end)
+                    break;
+
+                if (end - ip < 2)
+                    throw corrupt();
+                size_t const offset = size_t(static_cast<unsigned char>(ip[0])) | size_t(static_cast<unsigned char>(ip[1])) << 8;
+                ip += 2;
+
+                size_t const match = read_count(token & 15) + lz_min_match;
+                if (offset == 0 || offset > op || match > dst_size - op)
+                    throw corrupt();
+
+                if (offset >= match)
+                    std::memcpy(dst + op, dst + op - offset, match);
+                else
+                {
+                    // overlapping, repeats the last offset bytes
+                    for (size_t i = 0; i < match; ++i)
+                        dst[op + i] = dst[op + i - offset];
+                }
+                op += match;
+            }
+
+            if (op != dst_size)
+                throw corrupt();
+        }
+
+        inline bool record_log_codec_supported(record_log_codec codec)
+        {
+            switch (codec)
+            {
+            case record_log_codec::none:
+            case record_log_codec::lz:
+                return true;
+            case record_log_codec::zlib:
+#ifdef CORA_RECORD_LOG_HAS_ZLIB
+                return true;
+#else
+                return false;
+#endif
+            }
+            return false;
+        }
+
+        inline void record_log_compress(record_log_codec codec, int zlib_level, std::string const &raw, std::string &out)
+        {
+            out.clear();
+            switch (codec)
+            {
+            case record_log_codec::none:
+                out = raw;
+                break;
+            case record_log_codec::lz:
+                out.reserve(raw.size() + raw.size() / 255 + 16);
+                lz_compress(raw.data(), raw.size(), out);
+                break;
+            case record_log_codec::zlib:
+#ifdef CORA_RECORD_LOG_HAS_ZLIB
+            {
+                uLongf size = compressBound(uLong(raw.size()));
+                out.resize(size);
+                if (compress2(reinterpret_cast<Bytef *>(&out[0]), &size, reinterpret_cast<Bytef const *>(raw.data()), uLong(raw.size()), zlib_level) != Z_OK)
+                    throw record_log_error("record_log: zlib compression failed");
+                out.resize(size);
+                break;
+            }
+#else
+                (void)zlib_level;
+                throw record_log_error("record_log: zlib support is not compiled in");
+#endif
+            }
+        }
+
+        // out is resized to raw_size
+        inline void record_log_decompress(record_log_codec codec, std::string const &compressed, size_t raw_size, std::string &out)
+        {
+            out.resize(raw_size);
+            switch (codec)
+            {
+            case record_log_codec::none:
+                if (compressed.size() != raw_size)
+                    throw record_log_error("record_log: corrupt block");
+                out = compressed;
+                break;
+            case record_log_codec::lz:
+                lz_decompress(compressed.data(), compressed.size(), &out[0], raw_size);
+                break;
+            case record_log_codec::zlib:
+#ifdef CORA_RECORD_LOG_HAS_ZLIB
+            {
+                uLongf size = uLongf(raw_size);
+                if (uncompress(reinterpret_cast<Bytef *>(&out[0]), &size, reinterpret_cast<Bytef const *>(compressed.data()), uLong(compressed.size())) != Z_OK
+                    || size != raw_size)
+                    throw record_log_error("record_log: corrupt zlib block");
+                break;
+            }
+#else
+                throw record_log_error("record_log: zlib support is not compiled in");
+#endif
+            }
+        }
+
+        // a decompressed block: the records, then the uint32 end offset of each
+        struct record_log_block_view
+        {
+            record_log_block_view(std::string const &raw, size_t records_count)
+                : data_(raw.data())
+            {
+                size_t const table_size = records_count * sizeof(uint32_t);
+                if (table_size > raw.size())
+                    throw record_log_error("record_log: corrupt block");
+
+                records_size_ = raw.size() - table_size;
+                ends_ = raw.data() + records_size_;
+            }
+
+            template<typename T>
+            void decode(size_t i, T &record) const
+            {
+                size_t const begin = i == 0 ? 0 : end(i - 1);
+                size_t const finish = end(i);
+                if (begin > finish || finish > records_size_)
+                    throw record_log_error("record_log: corrupt block");
+
+                binary_io::string_to_data(std::string_view(data_ + begin, finish - begin), record);
+            }
+
+        private:
+            size_t end(size_t i) const
+            {
+                uint32_t value;
+                std::memcpy(&value, ends_ + i * sizeof(uint32_t), sizeof(value));
+                return value;
+            }
+
+        private:
+            char const *data_;
+            char const *ends_;
+            size_t records_size_;
+        };
+
+    } // namespace detail
+
+    template<typename T>
+    struct record_log_writer
+    {
+        // the log starts at the current position of s
+        explicit record_log_writer(std::ostream &s, record_log_options const &options = {})
+            : s_(s)
+            , options_(options)
+        {
+            start();
+        }
+
+        // key: a pointer to a field of T or a callable taking T const &, its value for every record
+        // gives the min/max of the blocks for record_log_reader::read_key_range
+        template<typename Key>
+        record_log_writer(std::ostream &s, Key key, record_log_options const &options = {})
+            : s_(s)
+            , options_(options)
+            , key_([key](std::string &out, T const &record) { append_sort_key(out, std::invoke(key, record)); })
+        {
+            start();
+        }
+
+        record_log_writer(record_log_writer const &) = delete;
+        record_log_writer &operator=(record_log_writer const &) = delete;
+
+        // errors of the last block and the index are reported by an explicit close() only
+        ~record_log_writer()
+        {
+            if (closed_)
+                return;
+
+            try
+            {
+                close();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        // returns the record number
+        uint64_t write(T const &record)
+        {
+            if (closed_)
+                throw std::logic_error("record_log_writer: write after close");
+
+            // a record that fails to encode is dropped whole, the block keeps only complete records
+            size_t const start = block_.size();
+            try
+            {
+                binary_io::write(block_, record);
+                if (block_.size() > std::numeric_limits<uint32_t>::max())
+                    throw std::length_error("record_log_writer: block exceeds 4 GB");
+
+                if (key_)
+                {
+                    key_buffer_.clear();
+                    key_(key_buffer_, record);
+                }
+                ends_.push_back(uint32_t(block_.size()));
+            }
+            catch (...)
+            {
+                block_.resize(start);
+                throw;
+            }
+
+            if (key_)
+            {
+                if (ends_.size() == 1 || key_buffer_ < min_key_)
+                    min_key_ = key_buffer_;
+                if (ends_.size() == 1 || key_buffer_ > max_key_)
+                    max_key_ = key_buffer_;
+            }
+
+            uint64_t const n = records_count_++;
+            if (ends_.size() >= options_.block_records || block_.size() >= options_.block_bytes)
+                flush_block();
+
+            return n;
+        }
+
+        uint64_t size() const
+        {
+            return records_count_;
+        }
+
+        // writes the last block, the index and the footer; the log is not readable before
+        void close()
+        {
+            if (closed_)
+                return;
+
+            flush_block();
+            closed_ = true;
+
+            std::string index;
+            binary_io::write(index, blocks_);
+            detail::record_log_footer const footer{ offset_, index.size(), records_count_, detail::record_log_index_magic };
+            binary_io::write(index, footer);
+
+            put(index);
+            s_.flush();
+            if (!s_)
+                throw record_log_error("record_log_writer: write failed");
+        }
+
+    private:
+        void start()
+        {
+            if (!detail::record_log_codec_supported(options_.codec))
+                throw std::invalid_argument("record_log_writer: codec is not available");
+
+            options_.block_records = std::max<size_t>(options_.block_records, 1);
+
+            detail::record_log_header const header{ detail::record_log_magic, cora::reflection::schema_fingerprint_v<T>,
+                uint32_t(options_.codec), key_ ? detail::record_log_has_key : 0u };
+            put(binary_io::data_to_string(header));
+        }
+
+        void flush_block()
+        {
+            if (ends_.empty())
+                return;
+
+            record_log_block block;
+            block.offset = offset_;
+            block.first_record = records_count_ - ends_.size();
+            block.records_count = uint32_t(ends_.size());
+
+            block_.append(reinterpret_cast<char const *>(ends_.data()), ends_.size() * sizeof(uint32_t));
+            if (block_.size() > std::numeric_limits<uint32_t>::max())
+                throw std::length_error("record_log_writer: block exceeds 4 GB");
+            block.raw_size = uint32_t(block_.size());
+
+            detail::record_log_compress(options_.codec, options_.zlib_level, block_, compressed_);
+            block.compressed_size = uint32_t(compressed_.size());
+            block.min_key.swap(min_key_);
+            block.max_key.swap(max_key_);
+
+            put(compressed_);
+            blocks_.push_back(std::move(block));
+
+            block_.clear();
+            ends_.clear();
+            min_key_.clear();
+            max_key_.clear();
+        }
+
+        void put(std::string const &data)
+        {
+            s_.write(data.data(), std::streamsize(data.size()));
+            if (!s_)
+                throw record_log_error("record_log_writer: write failed");
+            offset_ += data.size();
+        }
+
+    private:
+        std::ostream &s_;
+        record_log_options options_;
+        std::function<void(std::string &, T const &)> key_;
+
+        uint64_t offset_ = 0;
+        uint64_t records_count_ = 0;
+        std::vector<record_log_block> blocks_;
+        bool closed_ = false;
+
+        // the open block
+        std::string block_;
+        std::vector<uint32_t> ends_;
+        std::string min_key_;
+        std::string max_key_;
+
+        std::string key_buffer_;
+        std::string compressed_;
+    };
+
+    template<typename T>
+    struct record_log_reader
+    {
+        // the log starts at the current position of s and ends at the end of s, which must be seekable;
+        // throws record_log_error if it is not a complete log of T
+        explicit record_log_reader(std::istream &s)
+            : s_(s)
+            , base_(s.tellg())
+        {
+            if (base_ == std::istream::pos_type(-1))
+                throw record_log_error("record_log_reader: stream is not seekable");
+
+            detail::record_log_header header;
+            read_bytes(0, sizeof(header), buffer_);
+            binary_io::string_to_data(buffer_, header);
+            if (header.magic != detail::record_log_magic)
+                throw record_log_error("record_log_reader: not a record log");
+            if (header.fingerprint != cora::reflection::schema_fingerprint_v<T>)
+                throw record_log_error("record_log_reader: the log holds another record type");
+
+            codec_ = record_log_codec(header.codec);
+            if (!detail::record_log_codec_supported(codec_))
+                throw record_log_error("record_log_reader: codec is not available");
+            has_key_ = (header.flags & detail::record_log_has_key) != 0;
+
+            s_.seekg(0, std::ios::end);
+            uint64_t const size = uint64_t(s_.tellg() - base_);
+
+            detail::record_log_footer footer;
+            if (size < sizeof(header) + sizeof(footer))
+                throw record_log_error("record_log_reader: truncated log");
+            read_bytes(size - sizeof(footer), sizeof(footer), buffer_);
+            binary_io::string_to_data(buffer_, footer);
+            if (footer.magic != detail::record_log_index_magic)
+                throw record_log_error("record_log_reader: truncated log");
+            if (footer.index_offset < sizeof(header) || footer.index_offset > size - sizeof(footer)
+                || footer.index_size > size - sizeof(footer) - footer.index_offset)
+                throw record_log_error("record_log_reader: corrupt footer");
+
+            read_bytes(footer.index_offset, footer.index_size, buffer_);
+            try
+            {
+                binary_io::string_to_data(buffer_, blocks_);
+            }
+            catch (binary_io::decode_error const &e)
+            {
+                throw record_log_error(std::string("record_log_reader: corrupt index, ") + e.what());
+            }
+
+            // blocks must follow one another in records and in the file
+            uint64_t next_record = 0;
+            for (auto const &b : blocks_)
+            {
+                if (b.first_record != next_record || b.records_count == 0 || b.offset < sizeof(header)
+                    || b.compressed_size > footer.index_offset || b.offset > footer.index_offset - b.compressed_size)
+                    throw record_log_error("record_log_reader: corrupt index");
+                next_record += b.records_count;
+            }
+            if (next_record != footer.records_count)
+                throw record_log_error("record_log_reader: corrupt index");
+
+            records_count_ = footer.records_count;
+        }
+
+        record_log_reader(record_log_reader const &) = delete;
+        record_log_reader &operator=(record_log_reader const &) = delete;
+
+        uint64_t size() const
+        {
+            return records_count_;
+        }
+
+        bool has_key() const
+        {
+            return has_key_;
+        }
+
+        std::vector<record_log_block> const &blocks() const
+        {
+            return blocks_;
+        }
+
+        // the last block read is kept decompressed, reading records near one another costs a decode each
+        void read(uint64_t n, T &record)
+        {
+            if (n >= records_count_)
+                throw std::out_of_range("record_log_reader: no record " + std::to_string(n));
+
+            size_t const idx = block_of(n);
+            if (idx != cached_block_)
+            {
+                cached_block_ = size_t(-1);
+                read_block(idx, buffer_);
+                detail::record_log_decompress(codec_, buffer_, blocks_[idx].raw_size, cached_raw_);
+                cached_block_ = idx;
+            }
+
+            auto const &b = blocks_[idx];
+            detail::record_log_block_view(cached_raw_, b.records_count).decode(size_t(n - b.first_record), record);
+        }
+
+        T read(uint64_t n)
+        {
+            T record;
+            read(n, record);
+            return record;
+        }
+
+        // records [first, last), threads = 0 for all cores
+        std::vector<T> read_range(uint64_t first, uint64_t last, unsigned threads = 0)
+        {
+            last = std::min(last, records_count_);
+            if (first >= last)
+                return {};
+
+            size_t const first_block = block_of(first);
+            size_t const last_block = block_of(last - 1) + 1;
+
+            std::vector<size_t> selected;
+            for (size_t idx = first_block; idx != last_block; ++idx)
+                selected.push_back(idx);
+
+            std::vector<T> result(size_t(last - first));
+            decode_blocks(selected, threads, [this, &result, first, last](size_t, size_t idx, detail::record_log_block_view const &view)
+            {
+                auto const &b = blocks_[idx];
+                uint64_t const begin = std::max(first, b.first_record);
+                uint64_t const end = std::min(last, b.first_record + b.records_count);
+                for (uint64_t n = begin; n != end; ++n)
+                    view.decode(size_t(n - b.first_record), result[size_t(n - first)]);
+            });
+            return result;
+        }
+
+        // records with lo <= key(record) <= hi in log order, key as given to the writer (a field pointer or a callable);
+        // only the blocks whose min/max keys overlap the range are read, threads = 0 for all cores
+        template<typename Key, typename Bound>
+        std::vector<T> read_key_range(Key key, Bound const &lo, Bound const &hi, unsigned threads = 0)
+        {
+            if (!has_key_)
+                throw std::logic_error("record_log_reader: the log has no key");
+
+            // bounds are encoded as the key type, the sort keys of e.g. float and double differ
+            using key_type = std::decay_t<std::invoke_result_t<Key, T const &>>;
+            std::string const lo_key = make_sort_key(key_type(lo));
+            std::string const hi_key = make_sort_key(key_type(hi));
+
+            std::vector<size_t> selected;
+            for (size_t idx = 0; idx != blocks_.size(); ++idx)
+            {
+                if (blocks_[idx].max_key >= lo_key && blocks_[idx].min_key <= hi_key)
+                    selected.push_back(idx);
+            }
+
+            std::vector<std::vector<T>> parts(selected.size());
+            decode_blocks(selected, threads, [this, &parts, &key, &lo_key, &hi_key](size_t i, size_t idx, detail::record_log_block_view const &view)
+            {
+                std::string record_key;
+                T record;
+                for (size_t r = 0; r != blocks_[idx].records_count; ++r)
+                {
+                    view.decode(r, record);
+
+                    record_key.clear();
+                    append_sort_key(record_key, std::invoke(key, record));
+                    if (record_key >= lo_key && record_key <= hi_key)
+                        parts[i].push_back(std::move(record));
+                }
+            });
+
+            size_t total = 0;
+            for (auto const &part : parts)
+                total += part.size();
+
+            std::vector<T> result;
+            result.reserve(total);
+            for (auto &part : parts)
+                std::move(part.begin(), part.end(), std::back_inserter(result));
+            return result;
+        }
+
+    private:
+        size_t block_of(uint64_t n) const
+        {
+            auto it = std::upper_bound(blocks_.begin(), blocks_.end(), n,
+                [](uint64_t n, record_log_block const &b) { return n < b.first_record; });
+            return size_t(it - blocks_.begin()) - 1;
+        }
+
+        void read_bytes(uint64_t offset, uint64_t size, std::string &out)
+        {
+            out.resize(size_t(size));
+            s_.clear();
+            s_.seekg(base_ + std::streamoff(offset));
+            s_.read(&out[0], std::streamsize(size));
+            if (!s_ || uint64_t(s_.gcount()) != size)
+                throw record_log_error("record_log_reader: truncated log");
+        }
+
+        void read_block(size_t idx, std::string &out)
+        {
+            read_bytes(blocks_[idx].offset, blocks_[idx].compressed_size, out);
+        }
+
+        // reads the blocks one after another, then decompresses them in parallel and calls
+        // f(i, selected[i], view) for each, from several threads, the first exception is rethrown
+        template<typename F>
+        void decode_blocks(std::vector<size_t> const &selected, unsigned threads, F &&f)
+        {
+            if (selected.empty())
+                return;
+
+            std::vector<std::string> compressed(selected.size());
+            for (size_t i = 0; i != selected.size(); ++i)
+                read_block(selected[i], compressed[i]);
+
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            threads = unsigned(std::min<size_t>(threads, selected.size()));
+
+            std::vector<std::exception_ptr> errors(threads);
+            detail::parallel_chunks(selected.size(), threads, [&](size_t chunk, size_t begin, size_t end)
+            {
+                try
+                {
+                    std::string raw;
+                    for (size_t i = begin; i != end; ++i)
+                    {
+                        auto const &b = blocks_[selected[i]];
+                        detail::record_log_decompress(codec_, compressed[i], b.raw_size, raw);
+                        std::string().swap(compressed[i]);
+                        f(i, selected[i], detail::record_log_block_view(raw, b.records_count));
+                    }
+                }
+                catch (...)
+                {
+                    errors[chunk] = std::current_exception();
+                }
+            });
+
+            for (auto const &e : errors)
+            {
+                if (e)
+                    std::rethrow_exception(e);
+            }
+        }
+
+    private:
+        std::istream &s_;
+        std::istream::pos_type base_;
+        record_log_codec codec_ = record_log_codec::lz;
+        bool has_key_ = false;
+        uint64_t records_count_ = 0;
+        std::vector<record_log_block> blocks_;
+
+        std::string buffer_;
+        std::string cached_raw_;
+        size_t cached_block_ = size_t(-1);
+    };
+
+} // namespace cora
@@ -0,0 +1,404 @@
+#pragma once
+
+// Single producer, multiple consumer broadcast of reflected messages through POSIX shared memory.
+//
+// The segment is a ring of fixed size slots, every slot is guarded by its own sequence number (seqlock):
+// the publisher never waits for the subscribers, a subscriber that falls behind by more than the ring size
+// skips to the oldest message still available and counts the skipped ones in lost().
+// Messages are encoded with binary_io, trivially copyable ones are copied into and out of the slot as they are.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cora/reflection/refl_schema.h"
+#include "cora/serialization/binary_io.h"
+
+namespace cora
+{
+    namespace detail
+    {
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock-free");
+
+        constexpr uint64_t shm_ring_magic = 0x31474e4952415243ull; // "CORARNG1"
+        constexpr size_t shm_cache_line = 64;
+
+        struct shm_ring_header
+        {
+            std::atomic<uint64_t> magic;    // set last by the publisher, when the segment is ready
+            uint64_t fingerprint;           // schema_fingerprint_v of the message type
+            uint64_t slots_count;           // power of two
+            uint64_t slot_size;             // bytes, slot header included
+
+            alignas(shm_cache_line) std::atomic<uint64_t> published; // number of the last published message, they start from 1
+        };
+
+        // message n is in slot n % slots_count, its sequence is 2n - 1 while it is written and 2n when it is complete
+        struct shm_slot_header
+        {
+            std::atomic<uint64_t> sequence;
+            uint64_t size;
+        };
+
+        inline size_t shm_ring_bytes(size_t slots_count, size_t slot_size)
+        {
+            return sizeof(shm_ring_header) + slots_count * slot_size;
+        }
+
+        [[noreturn]] inline void throw_errno(char const *what, std::string const &name)
+        {
+            throw std::system_error(errno, std::generic_category(), std::string(what) + " " + name);
+        }
+
+        // maps the segment, the publisher creates it
+        struct shm_mapping
+        {
+            shm_mapping(std::string const &name, bool create, size_t bytes)
+                : name_(name)
+                , owner_(create)
+            {
+                // a stale segment is unlinked rather than truncated, subscribers still mapping it must not get SIGBUS
+                if (create)
+                    ::shm_unlink(name.c_str());
+
+                int const fd = create
+                    ? ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644)
+                    : ::shm_open(name.c_str(), O_RDONLY, 0);
+                if (fd < 0)
+                    throw_errno("shm_open", name);
+
+                if (create && ::ftruncate(fd, off_t(bytes)) != 0)
+                {
+                    int const err = errno;
+                    ::close(fd);
+                    ::shm_unlink(name.c_str());
+                    errno = err;
+                    throw_errno("ftruncate", name);
+                }
+
+                if (!create)
+                {
+                    struct stat st;
+                    if (::fstat(fd, &st) != 0)
+                    {
+                        int const err = errno;
+                        ::close(fd);
+                        errno = err;
+                        throw_errno("fstat", name);
+                    }
+                    bytes = size_t(st.st_size);
+                }
+
+                if (bytes < sizeof(shm_ring_header))
+                {
+                    ::close(fd);
+                    throw std::runtime_error("shm_ring: segment " + name + " is not initialized");
+                }
+
+                void *addr = ::mmap(nullptr, bytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (addr == MAP_FAILED)
+                {
+                    if (create)
+                        ::shm_unlink(name.c_str());
+                    throw_errno("mmap", name);
+                }
+
+                addr_ = static_cast<char *>(addr);
+                bytes_ = bytes;
+            }
+
+            shm_mapping(shm_mapping const &) = delete;
+            shm_mapping &operator=(shm_mapping const &) = delete;
+
+            ~shm_mapping()
+            {
+                ::munmap(addr_, bytes_);
+                if (owner_)
+                    ::shm_unlink(name_.c_str());
+            }
+
+            char *data() const { return addr_; }
+            size_t size() const { return bytes_; }
+
+        private:
+            std::string name_;
+            bool owner_;
+            char *addr_ = nullptr;
+            size_t bytes_ = 0;
+        };
+
+    } // namespace detail
+
+    template<typename T>
+    struct shm_publisher
+    {
+        // name as for shm_open, e.g. "/sim_state"; an existing segment of that name is replaced
+        // the segment is removed when the publisher is destroyed, subscribers keep their mappings
+        shm_publisher(std::string const &name, size_t slots_count = 1024, size_t max_message_size = 4096)
+            : slot_size_(slot_size_for(max_message_size))
+            , slots_count_(round_up_pow2(slots_count))
+            , map_(name, true, detail::shm_ring_bytes(slots_count_, slot_size_))
+        {
+            auto *header = ::new (map_.data()) detail::shm_ring_header;
+            header->fingerprint = cora::reflection::schema_fingerprint_v<T>;
+            header->slots_count = slots_count_;
+            header->slot_size = slot_size_;
+            header->published.store(0, std::memory_order_relaxed);
+
+            for (size_t i = 0; i < slots_count_; ++i)
+                ::new (slot(i)) detail::shm_slot_header{ { 0 }, 0 };
+
+            header->magic.store(detail::shm_ring_magic, std::memory_order_release);
+            header_ = header;
+        }
+
+        shm_publisher(shm_publisher const &) = delete;
+        shm_publisher &operator=(shm_publisher const &) = delete;
+
+        // returns the message number, throws std::length_error if the encoded message does not fit a slot
+        uint64_t publish(T const &msg)
+        {
+            char const *data;
+            size_t size;
+            if constexpr (binary_io::is_memcpy_v<T>)
+            {
+                data = reinterpret_cast<char const *>(&msg);
+                size = sizeof(T);
+            }
+            else
+            {
+                buffer_.clear();
+                binary_io::write(buffer_, msg);
+                data = buffer_.data();
+                size = buffer_.size();
+            }
+
+            if (size > slot_size_ - sizeof(detail::shm_slot_header))
+                throw std::length_error("shm_publisher: message of " + std::to_string(size) + " bytes does not fit the slot");
+
+            uint64_t const n = ++published_;
+            auto *s = slot(n & (slots_count_ - 1));
+
+            s->sequence.store(2 * n - 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            s->size = size;
+            std::memcpy(reinterpret_cast<char *>(s + 1), data, size);
+            s->sequence.store(2 * n, std::memory_order_release);
+
+            header_->published.store(n, std::memory_order_release);
+            return n;
+        }
+
+        uint64_t published() const
+        {
+            return published_;
+        }
+
+    private:
+        static size_t slot_size_for(size_t max_message_size)
+        {
+            size_t const bytes = sizeof(detail::shm_slot_header) + std::max<size_t>(max_message_size, binary_io::is_memcpy_v<T> ? sizeof(T) : 0);
+            return (bytes + detail::shm_cache_line - 1) / detail::shm_cache_line * detail::shm_cache_line;
+        }
+
+        static size_t round_up_pow2(size_t count)
+        {
+            size_t result = 2;
+            while (result < count)
+                result *= 2;
+            return result;
+        }
+
+        detail::shm_slot_header *slot(size_t idx) const
+        {
+            return reinterpret_cast<detail::shm_slot_header *>(map_.data() + sizeof(detail::shm_ring_header) + idx * slot_size_);
+        }
+
+    private:
+        size_t slot_size_;
+        size_t slots_count_;
+        detail::shm_mapping map_;
+        detail::shm_ring_header *header_ = nullptr;
+        uint64_t published_ = 0;
+        std::string buffer_;
+    };
+
+    template<typename T>
+    struct shm_subscriber
+    {
+        // throws std::system_error if there is no such segment and std::runtime_error if it carries another message type
+        // from_oldest: start with the oldest message still in the ring instead of the next published one
+        explicit shm_subscriber(std::string const &name, bool from_oldest = false)
+            : map_(name, false, 0)
+        {
+            header_ = reinterpret_cast<detail::shm_ring_header const *>(map_.data());
+            if (header_->magic.load(std::memory_order_acquire) != detail::shm_ring_magic)
+                throw std::runtime_error("shm_subscriber: segment " + name + " is not initialized");
+
+            if (header_->fingerprint != cora::reflection::schema_fingerprint_v<T>)
+                throw std::runtime_error("shm_subscriber: segment " + name + " carries another message type");
+
+            slots_count_ = header_->slots_count;
+            slot_size_ = header_->slot_size;
+            if (detail::shm_ring_bytes(slots_count_, slot_size_) > map_.size())
+                throw std::runtime_error("shm_subscriber: segment " + name + " is truncated");
+
+            uint64_t const published = header_->published.load(std::memory_order_acquire);
+            next_ = from_oldest ? oldest_available(published) : published + 1;
+        }
+
+        shm_subscriber(shm_subscriber const &) = delete;
+        shm_subscriber &operator=(shm_subscriber const &) = delete;
+
+        // polling: false if there is no new message
+        bool try_receive(T &msg)
+        {
+            for (;;)
+            {
+                auto const *s = slot(next_ & (slots_count_ - 1));
+                uint64_t const expected = 2 * next_;
+
+                uint64_t const sequence = s->sequence.load(std::memory_order_acquire);
+                if (sequence < expected)
+                    return false;
+
+                if (sequence > expected)
+                {
+                    skip_lapped();
+                    continue;
+                }
+
+                size_t const size = s->size;
+                bool const torn = binary_io::is_memcpy_v<T>
+                    ? size != sizeof(T)
+                    : size > slot_size_ - sizeof(detail::shm_slot_header);
+                if (!torn)
+                    copy_out(reinterpret_cast<char const *>(s + 1), size);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (torn || s->sequence.load(std::memory_order_relaxed) != sequence)
+                    continue; // overwritten while copied, the next round skips it
+
+                ++next_;
+                decode(msg);
+                return true;
+            }
+        }
+
+        // blocking: spins for a while, then yields and sleeps between polls
+        void receive(T &msg)
+        {
+            for (size_t round = 0; !try_receive(msg); ++round)
+                backoff(round);
+        }
+
+        // false on timeout
+        template<typename Rep, typename Period>
+        bool receive(T &msg, std::chrono::duration<Rep, Period> timeout)
+        {
+            auto const deadline = std::chrono::steady_clock::now() + timeout;
+            for (size_t round = 0; !try_receive(msg); ++round)
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                    return false;
+
+                backoff(round);
+            }
+            return true;
+        }
+
+        // messages overwritten before this subscriber got to them
+        uint64_t lost() const
+        {
+            return lost_;
+        }
+
+        // number of the message to be received next
+        uint64_t next() const
+        {
+            return next_;
+        }
+
+    private:
+        uint64_t oldest_available(uint64_t published) const
+        {
+            // the slot after the last published one is the first to be overwritten, so it is skipped too
+            return published >= slots_count_ ? published - slots_count_ + 2 : 1;
+        }
+
+        void skip_lapped()
+        {
+            uint64_t const oldest = oldest_available(header_->published.load(std::memory_order_acquire));
+            if (oldest > next_)
+            {
+                lost_ += oldest - next_;
+                next_ = oldest;
+            }
+            else
+            {
+                // the publisher is already writing the next lap, the message is gone
+                ++lost_;
+                ++next_;
+            }
+        }
+
+        void copy_out(char const *data, size_t size)
+        {
+            if constexpr (binary_io::is_memcpy_v<T>)
+                std::memcpy(&value_, data, size);
+            else
+                buffer_.assign(data, size);
+        }
+
+        void decode(T &msg)
+        {
+            if constexpr (binary_io::is_memcpy_v<T>)
+                msg = value_;
+            else
+                binary_io::string_to_data(buffer_, msg);
+        }
+
+        static void backoff(size_t round)
+        {
+            if (round < 1024)
+                return;
+
+            if (round < 1024 + 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        detail::shm_slot_header const *slot(size_t idx) const
+        {
+            return reinterpret_cast<detail::shm_slot_header const *>(map_.data() + sizeof(detail::shm_ring_header) + idx * slot_size_);
+        }
+
+    private:
+        detail::shm_mapping map_;
+        detail::shm_ring_header const *header_ = nullptr;
+        size_t slots_count_ = 0;
+        size_t slot_size_ = 0;
+        uint64_t next_ = 1;
+        uint64_t lost_ = 0;
+
+        std::conditional_t<binary_io::is_memcpy_v<T>, T, char> value_{};
+        std::string buffer_;
+    };
+
+} // namespace cora
@@ -0,0 +1,221 @@
+#include "cora/reflection/refl_instrumentation.h"
+#include "cora/serialization/json_io.h"
+#include "cora/serialization/binary_io.h"
+#include "cora/serialization/csv_io.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cora;
+
+CORA_INSTRUMENTATION_DEFINE_NEW()
+
+struct point_t
+{
+    int x = 0;
+    int y = 0;
+
+    REFL_INNER(point_t)
+        REFL_ENTRY(x)
+        REFL_ENTRY(y)
+    REFL_END()
+};
+
+struct segment_t
+{
+    point_t from;
+    point_t to;
+
+    REFL_INNER(segment_t)
+        REFL_ENTRY(from)
+        REFL_ENTRY(to)
+    REFL_END()
+};
+
+struct shape_t
+{
+    string name;
+    vector<point_t> points;
+    vector<segment_t> edges;
+    map<string, int> tags;
+
+    REFL_INNER(shape_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(points)
+        REFL_ENTRY(edges)
+        REFL_ENTRY(tags)
+    REFL_END()
+};
+
+namespace
+{
+    char const *const name_json   = R"("square")";
+    char const *const points_json = R"([{"x":0,"y":0},{"x":10,"y":0},{"x":10,"y":10}])";
+    char const *const edges_json  = R"([{"from":{"x":0,"y":0},"to":{"x":10,"y":0}},{"from":{"x":10,"y":0},"to":{"x":10,"y":10}}])";
+    char const *const tags_json   = R"({"a":1,"bb":22})";
+
+    shape_t make_shape()
+    {
+        shape_t shape;
+        shape.name = "square";
+        shape.points = { { 0, 0 }, { 10, 0 }, { 10, 10 } };
+        shape.edges = { { { 0, 0 }, { 10, 0 } }, { { 10, 0 }, { 10, 10 } } };
+        shape.tags = { { "a", 1 }, { "bb", 22 } };
+        return shape;
+    }
+
+    instrumentation::field_stats stats(string const &path)
+    {
+        auto const *st = instrumentation::profiler::instance().find(path);
+        EXPECT_NE(st, nullptr) << path;
+        return st ? *st : instrumentation::field_stats();
+    }
+
+    // same numbers whether the json was written or read
+    void expect_json_stats()
+    {
+        EXPECT_EQ(stats("root;name").calls, 1u);
+        EXPECT_EQ(stats("root;name").bytes, strlen(name_json));
+
+        EXPECT_EQ(stats("root;points").bytes, strlen(points_json));
+        EXPECT_EQ(stats("root;points").elements, 3u);
+        EXPECT_EQ(stats("root;points;x").calls, 3u);
+        EXPECT_EQ(stats("root;points;x").bytes, strlen("01010"));
+        EXPECT_EQ(stats("root;points;y").bytes, strlen("0010"));
+
+        // nested objects are measured once and reused by the enclosing fields
+        EXPECT_EQ(stats("root;edges").bytes, strlen(edges_json));
+        EXPECT_EQ(stats("root;edges").elements, 2u);
+        EXPECT_EQ(stats("root;edges;from").calls, 2u);
+        EXPECT_EQ(stats("root;edges;from").bytes, strlen(R"({"x":0,"y":0}{"x":10,"y":0})"));
+        EXPECT_EQ(stats("root;edges;from").elements, 4u);
+        EXPECT_EQ(stats("root;edges;to;y").calls, 2u);
+        EXPECT_EQ(stats("root;edges;to;y").bytes, strlen("010"));
+
+        EXPECT_EQ(stats("root;tags").bytes, strlen(tags_json));
+        EXPECT_EQ(stats("root;tags").elements, 2u);
+    }
+} // namespace
+
+TEST(refl_instrumentation, json_write)
+{
+    instrumentation::profiler::instance().reset();
+
+    string const json = json_io::data_to_string(make_shape());
+    EXPECT_EQ(json, string("{\"name\":") + name_json + ",\"points\":" + points_json + ",\"edges\":" + edges_json + ",\"tags\":" + tags_json + "}");
+
+    expect_json_stats();
+    EXPECT_EQ(instrumentation::profiler::instance().find("root;name;x"), nullptr);
+}
+
+TEST(refl_instrumentation, json_read)
+{
+    string const json = json_io::data_to_string(make_shape());
+    string const json_with_schema = json_io::data_to_string(make_shape(), false, true);
+
+    instrumentation::profiler::instance().reset();
+    shape_t parsed;
+    json_io::string_to_data(json, parsed);
+    expect_json_stats();
+
+    // positional decoding is measured the same way
+    instrumentation::profiler::instance().reset();
+    shape_t parsed_by_position;
+    json_io::string_to_data(json_with_schema, parsed_by_position);
+    expect_json_stats();
+}
+
+TEST(refl_instrumentation, folded_stacks)
+{
+    instrumentation::profiler::instance().reset();
+    json_io::data_to_string(make_shape());
+
+    stringstream folded;
+    instrumentation::profiler::instance().write_folded(folded);
+
+    vector<string> paths;
+    string line;
+    while (getline(folded, line))
+    {
+        size_t const space = line.rfind(' ');
+        ASSERT_NE(space, string::npos) << line;
+        EXPECT_EQ(line.find_first_not_of("0123456789", space + 1), string::npos) << line;
+        paths.push_back(line.substr(0, space));
+    }
+
+    vector<string> const expected = {
+        "root;edges",
+        "root;edges;from",
+        "root;edges;from;x",
+        "root;edges;from;y",
+        "root;edges;to",
+        "root;edges;to;x",
+        "root;edges;to;y",
+        "root;name",
+        "root;points",
+        "root;points;x",
+        "root;points;y",
+        "root;tags",
+    };
+    EXPECT_EQ(paths, expected);
+
+    stringstream report;
+    instrumentation::profiler::instance().report(report);
+    getline(report, line);
+    EXPECT_EQ(line.find("path"), 0u);
+    EXPECT_NE(line.find("elements"), string::npos);
+
+    size_t rows = 0;
+    while (getline(report, line))
+        ++rows;
+    EXPECT_EQ(rows, expected.size());
+}
+
+TEST(refl_instrumentation, binary_and_csv)
+{
+    instrumentation::profiler::instance().reset();
+    string binary;
+    binary_io::write(binary, make_shape());
+    EXPECT_EQ(stats("root;name").calls, 1u);
+    EXPECT_EQ(stats("root;edges").calls, 1u);
+    // trivially copyable elements are copied as a block, not field by field
+    EXPECT_EQ(instrumentation::profiler::instance().find("root;points;x"), nullptr);
+
+    instrumentation::profiler::instance().reset();
+    stringstream csv;
+    csv_io::write_csv_line(csv, point_t{ 10, 200 });
+    EXPECT_EQ(stats("root;x").calls, 1u);
+    EXPECT_EQ(stats("root;x").bytes + stats("root;y").bytes + 1, csv.str().size());
+}
+
+TEST(refl_instrumentation, overhead_is_not_charged)
+{
+    auto &p = instrumentation::profiler::instance();
+    p.reset();
+
+    {
+        instrumentation::field_scope scope("field");
+        vector<int> v(100);
+    }
+    EXPECT_EQ(stats("root;field").allocations, 1u);
+
+    {
+        instrumentation::field_scope scope("field");
+        instrumentation::overhead_scope overhead;
+        vector<int> v(100);
+    }
+    EXPECT_EQ(stats("root;field").calls, 2u);
+    EXPECT_EQ(stats("root;field").allocations, 1u);
+    EXPECT_EQ(p.overhead_allocations(), 1u);
+
+    // the nodes of new paths are not allocations of the field either
+    {
+        instrumentation::field_scope scope("a_new_field_with_a_long_name_to_be_allocated");
+    }
+    EXPECT_EQ(stats("root;a_new_field_with_a_long_name_to_be_allocated").allocations, 0u);
+}
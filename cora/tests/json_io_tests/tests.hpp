@@ -264,3 +264,469 @@ TEST(json_io, test_vector_of_bool)
     struct_diff_proc proc;
     reflect2(proc, original, parsed);
 }
+
+struct with_nested
+{
+    int id;
+    basic_data_types_t basic;
+    optional<basic_data_types_t> opt;
+    map<string, vector<int>> m;
+
+    REFL_INNER(with_nested)
+        REFL_ENTRY(id)
+        REFL_ENTRY(basic)
+        REFL_ENTRY(opt)
+        REFL_ENTRY(m)
+    REFL_END()
+};
+
+struct with_nested_reordered
+{
+    map<string, vector<int>> m;
+    basic_data_types_t basic;
+    int id;
+
+    REFL_INNER(with_nested_reordered)
+        REFL_ENTRY(m)
+        REFL_ENTRY(basic)
+        REFL_ENTRY(id)
+    REFL_END()
+};
+
+TEST(json_io, schema_fingerprint)
+{
+    static_assert(cora::reflection::schema_fingerprint_v<with_nested> == cora::reflection::schema_fingerprint_v<with_nested const>);
+    static_assert(cora::reflection::schema_fingerprint_v<with_nested> != cora::reflection::schema_fingerprint_v<with_nested_reordered>);
+    static_assert(cora::reflection::schema_fingerprint_v<with_optional> != cora::reflection::schema_fingerprint_v<complex_t>);
+
+    with_nested original;
+    original.id = 5;
+    original.basic = create_basic_types();
+    original.m = {{"a", {1, 2}}, {"b", {}}};
+
+    auto json = json_io::data_to_string(original, false, true);
+    EXPECT_EQ(json.find(json_io::schema_key), 2u);
+
+    // same schema, positional path
+    with_nested parsed;
+    json_io::string_to_data(json, parsed);
+    struct_diff_proc proc;
+    reflect2(proc, original, parsed);
+
+    // different schema, name lookup path
+    with_nested_reordered reordered;
+    json_io::string_to_data(json, reordered);
+    EXPECT_EQ(reordered.id, original.id);
+    EXPECT_EQ(reordered.m, original.m);
+    reflect2(proc, original.basic, reordered.basic);
+}
+
+TEST(json_io, positional_decoding_of_tampered_document)
+{
+    string const schema = "{\"" + string(json_io::schema_key) + "\":" + to_string(cora::reflection::schema_fingerprint_v<with_nested>);
+
+    // the fingerprint matches, but the members were reordered and some removed
+    with_nested parsed;
+    parsed.basic = create_basic_types();
+    parsed.opt = create_basic_types();
+    json_io::string_to_data(schema + ",\"m\":{\"a\":[1,2]},\"id\":5}", parsed);
+    EXPECT_EQ(parsed.id, 5);
+    EXPECT_EQ(parsed.m, (map<string, vector<int>>{{"a", {1, 2}}}));
+    EXPECT_EQ(parsed.basic.s, "");
+    EXPECT_FALSE(parsed.opt);
+
+    // fewer members than fields
+    json_io::string_to_data(schema + ",\"id\":6}", parsed);
+    EXPECT_EQ(parsed.id, 6);
+    EXPECT_TRUE(parsed.m.empty());
+
+    // a renamed member in place of a field
+    json_io::string_to_data(schema + ",\"id\":7,\"basics\":{\"i\":1},\"opt\":null,\"m\":{\"b\":[3]}}", parsed);
+    EXPECT_EQ(parsed.id, 7);
+    EXPECT_EQ(parsed.basic.i, 0);
+    EXPECT_EQ(parsed.m, (map<string, vector<int>>{{"b", {3}}}));
+}
+
+struct pmr_item_t
+{
+    std::pmr::string name;
+    std::pmr::vector<int> values;
+
+    REFL_INNER(pmr_item_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(values)
+    REFL_END()
+};
+
+struct pmr_message_t
+{
+    std::pmr::string title;
+    std::pmr::map<std::pmr::string, std::pmr::vector<pmr_item_t>> groups;
+    optional<pmr_item_t> extra;
+
+    REFL_INNER(pmr_message_t)
+        REFL_ENTRY(title)
+        REFL_ENTRY(groups)
+        REFL_ENTRY(extra)
+    REFL_END()
+};
+
+TEST(json_io, pmr_decoding_uses_arena)
+{
+    string long_str = "long enough to avoid the small string optimization";
+
+    pmr_message_t original;
+    original.title = long_str;
+    original.groups["first"].push_back(pmr_item_t{ std::pmr::string(long_str), {1, 2, 3} });
+    original.groups["second"];
+    original.extra = pmr_item_t{ std::pmr::string(long_str), {4} };
+    auto json = json_io::data_to_string(original);
+
+    std::pmr::monotonic_buffer_resource arena;
+    pmr_message_t parsed;
+    json_io::string_to_data(json, parsed, &arena);
+
+    EXPECT_EQ(parsed.title, original.title);
+    EXPECT_EQ(parsed.groups.size(), 2u);
+    ASSERT_EQ(parsed.groups["first"].size(), 1u);
+    EXPECT_EQ(parsed.groups["first"][0].name, original.groups["first"][0].name);
+    EXPECT_EQ(parsed.groups["first"][0].values, original.groups["first"][0].values);
+    ASSERT_TRUE(parsed.extra);
+    EXPECT_EQ(parsed.extra->values, original.extra->values);
+
+    EXPECT_EQ(parsed.title.get_allocator().resource(), &arena);
+    EXPECT_EQ(parsed.groups.get_allocator().resource(), &arena);
+    EXPECT_EQ(parsed.groups.begin()->first.get_allocator().resource(), &arena);
+    EXPECT_EQ(parsed.groups["first"][0].name.get_allocator().resource(), &arena);
+    EXPECT_EQ(parsed.groups["first"][0].values.get_allocator().resource(), &arena);
+    EXPECT_EQ(parsed.extra->name.get_allocator().resource(), &arena);
+}
+
+enum class color_t { red = 1, green = 2, blue = 10 };
+
+ENUM_DECL(color_t)
+    ENUM_DECL_ENTRY_S(red)
+    ENUM_DECL_ENTRY_S(green)
+    ENUM_DECL_ENTRY_S(blue)
+ENUM_DECL_END()
+
+enum class raw_enum_t : uint8_t { a, b };
+
+struct with_enums
+{
+    color_t color = color_t::red;
+    raw_enum_t raw = raw_enum_t::a;
+    vector<color_t> palette;
+
+    REFL_INNER(with_enums)
+        REFL_ENTRY(color)
+        REFL_ENTRY(raw)
+        REFL_ENTRY(palette)
+    REFL_END()
+};
+
+TEST(json_io, test_enums)
+{
+    with_enums obj;
+    obj.color = color_t::blue;
+    obj.raw = raw_enum_t::b;
+    obj.palette = { color_t::green, static_cast<color_t>(7) };
+    auto json = json_io::data_to_string(obj);
+    EXPECT_EQ(json, "{\"color\":\"blue\",\"raw\":1,\"palette\":[\"green\",7]}");
+
+    with_enums parsed;
+    json_io::string_to_data(json, parsed);
+    EXPECT_EQ(parsed.color, obj.color);
+    EXPECT_EQ(parsed.raw, obj.raw);
+    EXPECT_EQ(parsed.palette, obj.palette);
+
+    EXPECT_THROW(json_io::string_to_data("{\"color\":\"purple\"}", parsed), json_io::parse_error);
+}
+
+struct tracked_state_t
+{
+    cora::tracked<basic_data_types_t> basic;
+    cora::tracked<with_nested> nested;
+    map<string, cora::tracked<with_optional>> optionals;
+
+    REFL_INNER(tracked_state_t)
+        REFL_ENTRY(basic)
+        REFL_ENTRY(nested)
+        REFL_ENTRY(optionals)
+    REFL_END()
+};
+
+TEST(json_io, cached_writer_splices_unchanged_values)
+{
+    tracked_state_t state;
+    state.basic = basic_data_types_t{ true, 1, 2.5f, 3.5, "basic" };
+    state.optionals["first"].modify([](with_optional &v) { v.opt1 = 10; });
+    state.optionals["second"];
+
+    json_io::cached_writer writer;
+    EXPECT_EQ(writer.data_to_string(state), json_io::data_to_string(state));
+    EXPECT_EQ(writer.cached_values(), 4u);
+
+    auto const nested_version = state.nested.version();
+    state.basic.modify([](basic_data_types_t &v) { v.s = "changed"; });
+    EXPECT_EQ(state.nested.version(), nested_version);
+    EXPECT_EQ(writer.data_to_string(state), json_io::data_to_string(state));
+    EXPECT_EQ(writer.cached_values(), 4u);
+
+    state.optionals.erase("second");
+    EXPECT_EQ(writer.data_to_string(state), json_io::data_to_string(state));
+    EXPECT_EQ(writer.cached_values(), 3u);
+
+    tracked_state_t parsed;
+    json_io::string_to_data(json_io::data_to_string(state), parsed);
+    EXPECT_EQ(parsed.basic->s, "changed");
+    EXPECT_EQ(parsed.optionals["first"]->opt1, 10);
+}
+
+struct tracked_outer_t
+{
+    cora::tracked<with_optional> inner;
+    int id = 0;
+
+    REFL_INNER(tracked_outer_t)
+        REFL_ENTRY(inner)
+        REFL_ENTRY(id)
+    REFL_END()
+};
+
+struct tracked_root_t
+{
+    cora::tracked<tracked_outer_t> outer;
+
+    REFL_INNER(tracked_root_t)
+        REFL_ENTRY(outer)
+    REFL_END()
+};
+
+TEST(json_io, cached_writer_sees_nested_changes)
+{
+    tracked_root_t root;
+    auto &outer = root.outer;
+    json_io::cached_writer writer;
+    EXPECT_EQ(writer.data_to_string(root), json_io::data_to_string(root));
+
+    // the nested value is const but within the outer modify(), which gives both a new version
+    static_assert(is_const_v<remove_reference_t<decltype(*outer)>>);
+    static_assert(is_const_v<remove_reference_t<decltype(outer->inner.get())>>);
+    auto const outer_version = outer.version();
+    auto const inner_version = outer->inner.version();
+    outer.modify([](tracked_outer_t &v) { v.inner.modify([](with_optional &inner) { inner.opt1 = 5; }); });
+    EXPECT_NE(outer.version(), outer_version);
+    EXPECT_NE(outer->inner.version(), inner_version);
+    EXPECT_EQ(writer.data_to_string(root), json_io::data_to_string(root));
+    EXPECT_NE(json_io::data_to_string(root).find("\"opt1\":5"), string::npos);
+
+    // a modification that throws may have changed the value already, it gets a new version as well
+    auto const before_throw = outer.version();
+    EXPECT_THROW(outer.modify([](tracked_outer_t &v)
+    {
+        v.id = 7;
+        throw runtime_error("interrupted");
+    }), runtime_error);
+    EXPECT_NE(outer.version(), before_throw);
+    EXPECT_EQ(writer.data_to_string(root), json_io::data_to_string(root));
+    EXPECT_EQ(outer->id, 7);
+}
+
+struct soa_point_t
+{
+    int id = 0;
+    double x = 0;
+    double y = 0;
+    color_t color = color_t::red;
+
+    REFL_INNER(soa_point_t)
+        REFL_ENTRY(id)
+        REFL_ENTRY(x)
+        REFL_ENTRY(y)
+        REFL_ENTRY(color)
+    REFL_END()
+};
+
+struct with_points
+{
+    vector<soa_point_t> points;
+
+    REFL_INNER(with_points)
+        REFL_ENTRY(points)
+    REFL_END()
+};
+
+struct with_soa_points
+{
+    cora::soa_vector<soa_point_t> points;
+
+    REFL_INNER(with_soa_points)
+        REFL_ENTRY(points)
+    REFL_END()
+};
+
+TEST(json_io, soa_vector_as_array)
+{
+    with_points rows;
+    for(int i = 0; i < 5; ++i)
+        rows.points.push_back(soa_point_t{ i, i * 0.5, -i * 0.25, i % 2 ? color_t::green : color_t::blue });
+
+    with_soa_points columns;
+    columns.points = cora::soa_vector<soa_point_t>(rows.points);
+    auto json = json_io::data_to_string(rows);
+    EXPECT_EQ(json_io::data_to_string(columns), json);
+
+    with_soa_points parsed;
+    json_io::string_to_data(json, parsed);
+    ASSERT_EQ(parsed.points.size(), rows.points.size());
+    for(size_t i = 0; i < rows.points.size(); ++i)
+    {
+        soa_point_t const row = parsed.points[i];
+        EXPECT_EQ(row.id, rows.points[i].id);
+        EXPECT_EQ(row.x, rows.points[i].x);
+        EXPECT_EQ(row.color, rows.points[i].color);
+    }
+    EXPECT_EQ(parsed.points.column<double>("y")[4], -1.0);
+}
+
+struct interned_reading_t
+{
+    std::string_view unit;
+    vector<std::string_view> tags;
+    map<std::string_view, int> counts;
+    std::string name;
+
+    REFL_INNER(interned_reading_t)
+        REFL_ENTRY_TAG(unit, cora::interned)
+        REFL_ENTRY_TAG(tags, cora::interned)
+        REFL_ENTRY_TAG(counts, cora::interned)
+        REFL_ENTRY(name)
+    REFL_END()
+};
+
+TEST(json_io, interned_strings_are_shared)
+{
+    std::string const json = R"({"unit":"m/s","tags":["speed","raw","speed"],"counts":{"raw":1,"speed":2},"name":"first"})";
+
+    cora::string_pool pool;
+    interned_reading_t first, second;
+    json_io::string_to_data(json, first, pool);
+    json_io::string_to_data(json, second, pool);
+
+    EXPECT_EQ(first.unit, "m/s");
+    EXPECT_EQ(first.unit.data(), second.unit.data());
+    ASSERT_EQ(first.tags.size(), 3u);
+    EXPECT_EQ(first.tags[0].data(), first.tags[2].data());
+    EXPECT_EQ(first.counts.rbegin()->first.data(), first.tags[0].data());
+    EXPECT_EQ(first.counts.at("speed"), 2);
+    EXPECT_EQ(pool.size(), 3u);
+    EXPECT_EQ(pool.lookups(), 12u);
+
+    EXPECT_EQ(json_io::data_to_string(second), json);
+
+    interned_reading_t without_pool;
+    EXPECT_THROW(json_io::string_to_data(json, without_pool), json_io::parse_error);
+}
+
+struct size_probe_t
+{
+    int64_t i = 0;
+    uint8_t u = 0;
+    string s;
+    vector<int> v;
+    map<string, int> m;
+    optional<int> o;
+    color_t color = color_t::red;
+
+    REFL_INNER(size_probe_t)
+        REFL_ENTRY(i)
+        REFL_ENTRY(u)
+        REFL_ENTRY(s)
+        REFL_ENTRY(v)
+        REFL_ENTRY(m)
+        REFL_ENTRY(o)
+        REFL_ENTRY(color)
+    REFL_END()
+};
+
+TEST(json_io, encoded_size_bound)
+{
+    size_probe_t probe;
+    EXPECT_EQ(json_io::encoded_size_bound(probe), json_io::data_to_string(probe).size());
+
+    probe.i = std::numeric_limits<int64_t>::min();
+    probe.u = 200;
+    probe.s = "quote\" backslash\\ tab\t control\x01";
+    probe.v = { -1, 0, 10, 123456 };
+    probe.m = { { "a", 1 }, { "b\n", -20 } };
+    probe.o = 7;
+    probe.color = color_t::blue;
+    EXPECT_EQ(json_io::encoded_size_bound(probe), json_io::data_to_string(probe).size());
+    EXPECT_EQ(json_io::encoded_size_bound(probe, true), json_io::data_to_string(probe, false, true).size());
+
+    basic_data_types_t const basic = create_basic_types();
+    EXPECT_GE(json_io::encoded_size_bound(basic), json_io::data_to_string(basic).size());
+
+    string out = "prefix";
+    json_io::write_string(out, probe);
+    EXPECT_EQ(out, "prefix" + json_io::data_to_string(probe));
+}
+
+struct move_order_t
+{
+    double x = 0;
+    double y = 0;
+
+    REFL_INNER(move_order_t)
+        REFL_ENTRY(x)
+        REFL_ENTRY(y)
+    REFL_END()
+};
+
+struct fire_order_t
+{
+    int target = 0;
+
+    REFL_INNER(fire_order_t)
+        REFL_ENTRY(target)
+    REFL_END()
+};
+
+using order_t = std::variant<std::monostate, move_order_t, fire_order_t, string>;
+
+struct with_orders
+{
+    vector<order_t> orders;
+    order_t last;
+
+    REFL_INNER(with_orders)
+        REFL_ENTRY(orders)
+        REFL_ENTRY(last)
+    REFL_END()
+};
+
+TEST(json_io, variant_as_type_and_value)
+{
+    with_orders data;
+    data.orders = { move_order_t{ 1.5, -2 }, fire_order_t{ 7 }, string("hold"), std::monostate() };
+    data.last = fire_order_t{ 3 };
+
+    auto json = json_io::data_to_string(data);
+    EXPECT_NE(json.find(R"({"type":2,"value":{"target":7}})"), string::npos);
+    EXPECT_NE(json.find(R"({"type":0})"), string::npos);
+    EXPECT_GE(json_io::encoded_size_bound(data), json.size());
+
+    with_orders parsed;
+    parsed.last = string("replaced");
+    json_io::string_to_data(json, parsed);
+    ASSERT_EQ(parsed.orders.size(), 4u);
+    EXPECT_EQ(std::get<move_order_t>(parsed.orders[0]).y, -2);
+    EXPECT_EQ(std::get<fire_order_t>(parsed.orders[1]).target, 7);
+    EXPECT_EQ(std::get<string>(parsed.orders[2]), "hold");
+    EXPECT_EQ(parsed.orders[3].index(), 0u);
+    EXPECT_EQ(std::get<fire_order_t>(parsed.last).target, 3);
+
+    with_orders bad;
+    EXPECT_THROW(json_io::string_to_data(R"({"orders":[{"type":4,"value":1}]})", bad), json_io::parse_error);
+}
@@ -0,0 +1 @@
+#include "tests.hpp"
\ No newline at end of file
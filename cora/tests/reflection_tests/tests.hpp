@@ -0,0 +1,847 @@
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_assign.h"
+#include "cora/reflection/refl_instrumentation.h"
+#include "cora/reflection/refl_memory.h"
+#include "cora/reflection/refl_operators.h"
+#include "cora/reflection/refl_soa.h"
+#include "cora/reflection/refl_sort_key.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct point_t
+{
+    double x;
+    double y;
+
+    REFL_INNER(point_t)
+        REFL_ENTRY(x)
+        REFL_ENTRY(y)
+    REFL_END()
+};
+
+struct unit_tag
+{
+};
+
+struct base_t
+{
+    int id = 0;
+    string name;
+
+    REFL_INNER(base_t)
+        REFL_ENTRY(id)
+        REFL_ENTRY(name)
+    REFL_END()
+};
+
+struct derived_t
+    : base_t
+{
+    point_t pos;
+    vector<int> values;
+
+    REFL_INNER(derived_t)
+        REFL_ENTRY_TAG(pos, unit_tag())
+        REFL_CHAIN(base_t)
+        REFL_ENTRY(values)
+    REFL_END()
+};
+
+struct not_reflected_t
+{
+    int a;
+};
+
+// collects the field names and counts the tagged ones
+struct names_proc
+{
+    template<typename T>
+    void operator()(T const &, char const *name)
+    {
+        names.push_back(name);
+    }
+
+    template<typename T>
+    void operator()(T const &, char const *name, unit_tag)
+    {
+        names.push_back(name);
+        ++tagged;
+    }
+
+    vector<string> names;
+    int tagged = 0;
+};
+
+TEST(reflection, fields_of_chained_types)
+{
+    static_assert(cora::reflection::is_reflected_v<derived_t>);
+    static_assert(cora::reflection::is_reflected_v<derived_t const &>);
+    static_assert(!cora::reflection::is_reflected_v<not_reflected_t>);
+    static_assert(!cora::reflection::is_reflected_v<int>);
+
+    // REFL_CHAIN is one entry of its own, all_fields expands it in place
+    static_assert(std::tuple_size_v<decltype(cora::reflection::own_fields<derived_t>())> == 3);
+    static_assert(cora::reflection::fields_count_v<derived_t> == 4);
+    static_assert(cora::reflection::fields_count_v<base_t> == 2);
+
+    static_assert(std::is_same_v<cora::reflection::field_t<derived_t, 0>, point_t>);
+    static_assert(std::is_same_v<cora::reflection::field_t<derived_t, 1>, int>);
+    static_assert(std::is_same_v<cora::reflection::field_t<derived_t, 2>, string>);
+    static_assert(std::is_same_v<cora::reflection::field_t<derived_t, 3>, vector<int>>);
+
+    EXPECT_STREQ((cora::reflection::field_name_v<derived_t, 0>), "pos");
+    EXPECT_STREQ((cora::reflection::field_name_v<derived_t, 1>), "id");
+    EXPECT_STREQ((cora::reflection::field_name_v<derived_t, 2>), "name");
+    EXPECT_STREQ((cora::reflection::field_name_v<derived_t, 3>), "values");
+}
+
+TEST(reflection, for_each_field)
+{
+    vector<string> names;
+    cora::reflection::for_each_field<derived_t>([&names](auto const &desc)
+    {
+        names.push_back(desc.name);
+    });
+    EXPECT_EQ(names, (vector<string>{ "pos", "id", "name", "values" }));
+
+    derived_t obj;
+    obj.id = 7;
+    obj.name = "seven";
+    obj.pos = { 1.5, 2.5 };
+
+    // members are references into obj
+    cora::reflection::for_each_field(obj, [](auto &member, auto const &desc)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(member)>, int>)
+        {
+            EXPECT_STREQ(desc.name, "id");
+            member = 8;
+        }
+    });
+    EXPECT_EQ(obj.id, 8);
+
+    derived_t const &cobj = obj;
+    cora::reflection::for_each_field(cobj, [](auto &member, auto const &)
+    {
+        static_assert(std::is_const_v<std::remove_reference_t<decltype(member)>>);
+    });
+}
+
+TEST(reflection, reflect_passes_names_and_tags)
+{
+    derived_t obj;
+    names_proc proc;
+    reflect(proc, obj);
+    EXPECT_EQ(proc.names, (vector<string>{ "pos", "id", "name", "values" }));
+    EXPECT_EQ(proc.tagged, 1);
+}
+
+struct sum_proc : cora::reflection::processor2
+{
+    template<typename T>
+    void operator()(T const &l, T const &r, char const *)
+    {
+        if constexpr (std::is_arithmetic_v<T>)
+            sum += double(l) + double(r);
+        else if constexpr (cora::reflection::is_reflected_v<T>)
+            reflect2(*this, l, r);
+    }
+
+    template<typename T, typename Tag>
+    void operator()(T const &l, T const &r, char const *name, Tag)
+    {
+        (*this)(l, r, name);
+    }
+
+    double sum = 0;
+};
+
+TEST(reflection, reflect2_visits_both_objects)
+{
+    derived_t l;
+    l.id = 1;
+    l.pos = { 2, 3 };
+    derived_t r;
+    r.id = 10;
+    r.pos = { 20, 30 };
+
+    sum_proc proc;
+    reflect2(proc, l, r);
+    EXPECT_DOUBLE_EQ(proc.sum, 66);
+}
+
+struct view_t
+{
+    explicit view_t(point_t &target)
+        : target(target)
+    {
+    }
+
+    point_t &target;
+    point_t pos;
+
+    REFL_INNER(view_t)
+        REFL_ENTRY_EXPR(target, "target")
+        REFL_ENTRY_EXPR(pos.x, "x")
+        REFL_ENTRY_EXPR_WITH_TAG(pos.y, "y", unit_tag())
+    REFL_END()
+};
+
+TEST(reflection, entries_by_expression)
+{
+    static_assert(cora::reflection::fields_count_v<view_t> == 3);
+    static_assert(std::is_same_v<cora::reflection::field_t<view_t, 0>, point_t>);
+    static_assert(std::is_same_v<cora::reflection::field_t<view_t, 1>, double>);
+
+    point_t target{ 1, 2 };
+    view_t view(target);
+    view.pos = { 3, 4 };
+
+    names_proc proc;
+    reflect(proc, view);
+    EXPECT_EQ(proc.names, (vector<string>{ "target", "x", "y" }));
+    EXPECT_EQ(proc.tagged, 1);
+
+    cora::reflection::for_each_field(view, [](auto &member, auto const &)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(member)>, double>)
+            member *= 10;
+        else
+            member.x = -1;
+    });
+    EXPECT_EQ(target.x, -1);
+    EXPECT_EQ(view.pos.x, 30);
+    EXPECT_EQ(view.pos.y, 40);
+}
+
+// as written before REFL_ENTRY_EXPR: plain REFL_ENTRY falls back to a getter where there is no member pointer
+struct plain_view_t
+{
+    explicit plain_view_t(point_t &target)
+        : target(target)
+    {
+    }
+
+    point_t &target;
+    point_t pos;
+    int id = 0;
+
+    REFL_INNER(plain_view_t)
+        REFL_ENTRY(target)
+        REFL_ENTRY(pos.x)
+        REFL_ENTRY_TAG(pos.y, unit_tag())
+        REFL_ENTRY(id)
+    REFL_END()
+};
+
+template<typename Desc>
+constexpr bool is_accessor_v = false;
+
+template<typename Owner, typename Member, typename Getter, typename... Tags>
+constexpr bool is_accessor_v<cora::reflection::accessor_desc<Owner, Member, Getter, Tags...>> = true;
+
+TEST(reflection, plain_entries_without_member_pointer)
+{
+    using namespace cora::reflection;
+
+    using fields = decltype(own_fields<plain_view_t>());
+    static_assert(is_accessor_v<std::tuple_element_t<0, fields>>);
+    static_assert(is_accessor_v<std::tuple_element_t<1, fields>>);
+    static_assert(!is_accessor_v<std::tuple_element_t<3, fields>>);
+    static_assert(std::is_same_v<field_t<plain_view_t, 0>, point_t>);
+    static_assert(std::is_same_v<field_t<plain_view_t, 2>, double>);
+
+    point_t target{ 1, 2 };
+    plain_view_t view(target);
+    view.pos = { 3, 4 };
+
+    names_proc proc;
+    reflect(proc, view);
+    EXPECT_EQ(proc.names, (vector<string>{ "target", "pos.x", "pos.y", "id" }));
+    EXPECT_EQ(proc.tagged, 1);
+
+    for_each_field(view, [](auto &member, auto const &)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(member)>, point_t>)
+            member.x = -1;
+        else
+            member *= 10;
+    });
+    EXPECT_EQ(target.x, -1);
+    EXPECT_EQ(view.pos.x, 30);
+    EXPECT_EQ(view.pos.y, 40);
+}
+
+// counts the allocations and the bytes in use, other resources compare unequal
+struct counting_resource
+    : std::pmr::memory_resource
+{
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+private:
+    void *do_allocate(size_t size, size_t alignment) override
+    {
+        ++allocations;
+        bytes += size;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *p, size_t size, size_t alignment) override
+    {
+        bytes -= size;
+        std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+struct inner_t
+{
+    std::pmr::string name;
+    std::pmr::vector<int> values;
+
+    REFL_INNER(inner_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(values)
+    REFL_END()
+};
+
+struct outer_t
+{
+    std::pmr::string title;
+    std::pmr::map<std::pmr::string, std::pmr::vector<optional<inner_t>>> groups;
+    vector<inner_t> items;
+    optional<inner_t> extra;
+    map<std::pmr::string, int> counts;
+
+    REFL_INNER(outer_t)
+        REFL_ENTRY(title)
+        REFL_ENTRY(groups)
+        REFL_ENTRY(items)
+        REFL_ENTRY(extra)
+        REFL_ENTRY(counts)
+    REFL_END()
+};
+
+// pmr containers found in v at any nesting level, and those of them that do not use resource
+struct resource_census
+{
+    explicit resource_census(std::pmr::memory_resource *resource)
+        : resource(resource)
+    {
+    }
+
+    template<typename T>
+    void visit(T const &v)
+    {
+        namespace traits = cora::reflection::traits;
+
+        if constexpr (cora::reflection::is_reflected_v<T>)
+            cora::reflection::for_each_field(v, [this](auto const &member, auto const &) { visit(member); });
+        else if constexpr (traits::is_optional<T>::value)
+        {
+            if (v)
+                visit(*v);
+        }
+        else
+        {
+            if constexpr (cora::reflection::traits::has_polymorphic_allocator<T>::value)
+            {
+                ++total;
+                if (v.get_allocator().resource() != resource)
+                    ++foreign;
+            }
+
+            if constexpr (traits::is_map<T>::value)
+            {
+                for (auto const &elem : v)
+                {
+                    visit(elem.first);
+                    visit(elem.second);
+                }
+            }
+            else if constexpr (traits::is_container<T>::value)
+            {
+                for (auto const &elem : v)
+                    visit(elem);
+            }
+        }
+    }
+
+    std::pmr::memory_resource *resource;
+    size_t total = 0;
+    size_t foreign = 0;
+};
+
+char const *const long_text = "long enough to avoid the small string optimization";
+
+inner_t make_inner(int n)
+{
+    inner_t inner;
+    inner.name = long_text;
+    inner.name += to_string(n);
+    inner.values.assign(size_t(n + 1), n);
+    return inner;
+}
+
+outer_t make_outer()
+{
+    outer_t obj;
+    obj.title = long_text;
+    obj.groups[std::pmr::string(long_text) + "a"] = { make_inner(1), nullopt, make_inner(2) };
+    obj.groups[std::pmr::string(long_text) + "b"] = { make_inner(3) };
+    obj.items = { make_inner(4), make_inner(5) };
+    obj.extra = make_inner(6);
+    obj.counts[std::pmr::string(long_text) + "c"] = 1;
+    obj.counts[std::pmr::string(long_text) + "d"] = 2;
+    return obj;
+}
+
+TEST(refl_assign, rebind_populated_object)
+{
+    counting_resource arena;
+    outer_t obj = make_outer();
+
+    resource_census before(&arena);
+    before.visit(obj);
+    EXPECT_EQ(before.foreign, before.total);
+
+    cora::reflect_rebind_resource(obj, &arena);
+
+    resource_census after(&arena);
+    after.visit(obj);
+    EXPECT_EQ(after.total, before.total);
+    EXPECT_EQ(after.foreign, 0u);
+
+    // the content survives
+    outer_t const expected = make_outer();
+    EXPECT_EQ(obj.title, expected.title);
+    EXPECT_EQ(obj.groups.size(), 2u);
+    EXPECT_EQ(obj.groups.begin()->second[2]->values, expected.groups.begin()->second[2]->values);
+    EXPECT_EQ(obj.items[1].name, expected.items[1].name);
+    EXPECT_EQ(obj.counts.begin()->second, 1);
+    EXPECT_EQ(obj.counts.begin()->first, expected.counts.begin()->first);
+
+    // rebinding to the same resource again allocates nothing
+    size_t const allocations = arena.allocations;
+    cora::reflect_rebind_resource(obj, &arena);
+    EXPECT_EQ(arena.allocations, allocations);
+}
+
+TEST(refl_assign, assign_reuses_storage)
+{
+    counting_resource arena;
+    outer_t const src = make_outer();
+    outer_t dst = cora::reflect_copy_into(outer_t(), &arena);
+
+    cora::reflect_assign(dst, src);
+    EXPECT_EQ(dst.title, src.title);
+    EXPECT_EQ(dst.groups.begin()->second[0]->name, src.groups.begin()->second[0]->name);
+    EXPECT_FALSE(dst.groups.begin()->second[1]);
+    EXPECT_EQ(dst.items[1].values, src.items[1].values);
+    EXPECT_EQ(dst.counts, src.counts);
+
+    // the same shape again: strings, vectors, map nodes and optional values are all reused
+    size_t const allocations = arena.allocations;
+    char const *title = dst.title.data();
+    cora::reflect_assign(dst, src);
+    cora::reflect_assign(dst, make_outer());
+    EXPECT_EQ(arena.allocations, allocations);
+    EXPECT_EQ(dst.title.data(), title);
+
+    // shrinking keeps the capacity
+    outer_t smaller = make_outer();
+    smaller.items.front().values.resize(1);
+    size_t const capacity = dst.items.front().values.capacity();
+    cora::reflect_assign(dst, smaller);
+    EXPECT_EQ(dst.items.front().values.size(), 1u);
+    EXPECT_EQ(dst.items.front().values.capacity(), capacity);
+}
+
+TEST(refl_assign, copy_into_resource)
+{
+    counting_resource arena;
+    outer_t const src = make_outer();
+    outer_t copy = cora::reflect_copy_into(src, &arena);
+
+    resource_census census(&arena);
+    census.visit(copy);
+    EXPECT_GT(census.total, 0u);
+    EXPECT_EQ(census.foreign, 0u);
+    EXPECT_GT(arena.bytes, 0u);
+    EXPECT_EQ(copy.extra->name, src.extra->name);
+    EXPECT_EQ(copy.groups.size(), src.groups.size());
+}
+
+TEST(refl_assign, swap_across_resources)
+{
+    counting_resource arena_a;
+    counting_resource arena_b;
+
+    outer_t a = cora::reflect_copy_into(make_outer(), &arena_a);
+    outer_t b = cora::reflect_copy_into(outer_t(), &arena_b);
+    b.title = "b";
+
+    cora::reflect_swap(a, b);
+
+    EXPECT_EQ(a.title, "b");
+    EXPECT_EQ(b.title, long_text);
+    EXPECT_EQ(b.groups.size(), 2u);
+    EXPECT_EQ(a.title.get_allocator().resource(), &arena_a);
+    EXPECT_EQ(b.title.get_allocator().resource(), &arena_b);
+    EXPECT_EQ(b.groups.get_allocator().resource(), &arena_b);
+}
+
+TEST(refl_assign, move_keeps_destination_resource)
+{
+    counting_resource arena;
+    outer_t dst;
+    cora::reflect_rebind_resource(dst, &arena);
+
+    outer_t src = make_outer();
+    cora::reflect_move_into(dst, src);
+
+    EXPECT_EQ(dst.title, long_text);
+    EXPECT_EQ(dst.groups.size(), 2u);
+    EXPECT_EQ(dst.items.size(), 2u);
+    EXPECT_EQ(dst.title.get_allocator().resource(), &arena);
+    EXPECT_EQ(dst.groups.get_allocator().resource(), &arena);
+}
+
+TEST(refl_instrumentation, disabled_by_default)
+{
+    // without CORA_ENABLE_INSTRUMENTATION the macros expand to nothing, their arguments included
+    int evaluated = 0;
+    CORA_INSTRUMENT_FIELD(scope, "field");
+    CORA_INSTRUMENT_BYTES(scope, ++evaluated);
+    CORA_INSTRUMENT_ELEMENTS(scope, ++evaluated);
+    CORA_INSTRUMENT_CODE(++evaluated;)
+    EXPECT_EQ(evaluated, 0);
+}
+
+struct sortable_t
+{
+    string name;
+    int rank = 0;
+    double score = 0;
+    optional<int> level;
+    vector<int16_t> path;
+    int id = 0; // not reflected, tells equal records apart
+
+    ENABLE_REFL_CMP(sortable_t)
+
+    REFL_INNER(sortable_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(rank)
+        REFL_ENTRY(score)
+        REFL_ENTRY(level)
+        REFL_ENTRY(path)
+    REFL_END()
+};
+
+namespace
+{
+    // few distinct values, so that there are many equal records, keys sharing long prefixes,
+    // embedded zeros, bytes above 0x7f, negative and signed zero numbers
+    vector<sortable_t> make_sortables(size_t count, unsigned seed)
+    {
+        mt19937 gen(seed);
+        auto const pick = [&gen](size_t n) { return size_t(gen() % n); };
+
+        string const names[] = { "", "a", "ab", string("a\0b", 3), "\xff", "b", "a_rather_long_common_prefix_", "a_rather_long_common_prefix_x" };
+        double const scores[] = { -1.5, -0.0, 0.0, 2.25, 1e300, -1e-300 };
+
+        vector<sortable_t> v(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto &r = v[i];
+            r.name = names[pick(size(names))];
+            if (pick(2))
+                r.name += names[pick(size(names))];
+            r.rank = int(pick(5)) - 2;
+            r.score = scores[pick(size(scores))];
+            if (pick(2))
+                r.level = int(pick(3)) - 1;
+            r.path.resize(pick(3));
+            for (auto &p : r.path)
+                p = int16_t(int(pick(3)) - 1);
+            r.id = int(i);
+        }
+        return v;
+    }
+
+    int compare_keys(string const &a, string const &b)
+    {
+        int const cmp = memcmp(a.data(), b.data(), min(a.size(), b.size()));
+        return cmp != 0 ? cmp : int(a.size() > b.size()) - int(a.size() < b.size());
+    }
+} // namespace
+
+TEST(sort_key, bytewise_order_matches_operator_less)
+{
+    auto const records = make_sortables(400, 1);
+
+    vector<string> keys;
+    for (auto const &r : records)
+        keys.push_back(cora::make_sort_key(r));
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        for (size_t j = 0; j < records.size(); ++j)
+        {
+            int const cmp = compare_keys(keys[i], keys[j]);
+            EXPECT_EQ(cmp < 0, records[i] < records[j]) << i << " " << j;
+            EXPECT_EQ(cmp == 0, records[i] == records[j]) << i << " " << j;
+        }
+    }
+}
+
+TEST(sort_key, parallel_sort_matches_stable_sort)
+{
+    for (size_t count : { size_t(0), size_t(1), size_t(7), size_t(5000), size_t(60000) })
+    {
+        for (unsigned threads : { 1u, 3u, 8u })
+        {
+            auto expected = make_sortables(count, unsigned(count + threads));
+            auto sorted = expected;
+
+            stable_sort(expected.begin(), expected.end());
+            cora::parallel_sort_by_key(sorted, threads);
+
+            ASSERT_EQ(sorted.size(), expected.size());
+            for (size_t i = 0; i < sorted.size(); ++i)
+                ASSERT_EQ(sorted[i].id, expected[i].id) << "count " << count << ", threads " << threads << ", at " << i;
+        }
+    }
+}
+
+struct particle_t
+{
+    int id = 0;
+    int charge = 0;
+    point_t pos;
+
+    REFL_INNER(particle_t)
+        REFL_ENTRY(id)
+        REFL_ENTRY(charge)
+        REFL_ENTRY(pos)
+    REFL_END()
+};
+
+TEST(soa_vector, iterator_arithmetic_and_comparison)
+{
+    cora::soa_vector<particle_t> soa(vector<particle_t>(5));
+    auto const first = soa.begin();
+    auto const third = first + 2;
+
+    EXPECT_TRUE(2 + first == third);
+    EXPECT_TRUE(third - 2 == first);
+    EXPECT_EQ(third - first, 2);
+    EXPECT_EQ(soa.end() - soa.begin(), 5);
+
+    EXPECT_TRUE(first < third);
+    EXPECT_TRUE(third > first);
+    EXPECT_TRUE(first <= third && third <= third);
+    EXPECT_TRUE(third >= first && third >= third);
+    EXPECT_FALSE(first > third || third < first || first >= third || third <= first);
+}
+
+TEST(soa_vector, standard_algorithms)
+{
+    mt19937 gen(7);
+    vector<particle_t> rows(1000);
+    for (size_t i = 0; i < rows.size(); ++i)
+        rows[i] = particle_t{ int(i), int(gen() % 10), point_t{ double(gen() % 100), double(i) } };
+
+    auto const by_charge = [](particle_t const &a, particle_t const &b) { return a.charge < b.charge; };
+
+    cora::soa_vector<particle_t> soa(rows);
+    std::sort(soa.begin(), soa.end(), [](particle_t const &a, particle_t const &b)
+    {
+        return a.charge != b.charge ? a.charge < b.charge : a.id < b.id;
+    });
+    EXPECT_TRUE(std::is_sorted(soa.begin(), soa.end(), by_charge));
+
+    // the rows stay whole, every column is moved along
+    for (size_t i = 0; i < soa.size(); ++i)
+    {
+        particle_t const p = soa[i];
+        EXPECT_EQ(p.pos.y, double(p.id));
+        EXPECT_EQ(p.charge, rows[size_t(p.id)].charge);
+        EXPECT_EQ(p.pos.x, rows[size_t(p.id)].pos.x);
+    }
+
+    cora::soa_vector<particle_t> stable(rows);
+    std::stable_sort(stable.begin(), stable.end(), by_charge);
+    std::stable_sort(rows.begin(), rows.end(), by_charge);
+    for (size_t i = 0; i < rows.size(); ++i)
+        EXPECT_EQ(particle_t(stable[i]).id, rows[i].id);
+
+    auto const it = std::lower_bound(stable.begin(), stable.end(), particle_t{ 0, 5, {} }, by_charge);
+    EXPECT_EQ(it - stable.begin(), std::lower_bound(rows.begin(), rows.end(), particle_t{ 0, 5, {} }, by_charge) - rows.begin());
+
+    std::reverse(stable.begin(), stable.end());
+    EXPECT_EQ(particle_t(stable.front()).id, rows.back().id);
+}
+
+enum class wide_t : int64_t { lowest = INT64_MIN, zero = 0, highest = INT64_MAX };
+enum class compact_t : int64_t { a = -3, b = -2, c = 5 };
+
+TEST(enum_table, extreme_values)
+{
+    using cora::reflection::enum_table;
+
+    // too sparse for a dense index, the span does not fit into int64_t
+    enum_table<wide_t> const wide = { { wide_t::lowest, "lowest" }, { wide_t::zero, "zero" }, { wide_t::highest, "highest" } };
+    EXPECT_EQ(wide.to_string(wide_t::lowest), "lowest");
+    EXPECT_EQ(wide.to_string(wide_t::highest), "highest");
+    EXPECT_EQ(wide.to_string(wide_t(1)), std::nullopt);
+    EXPECT_EQ(wide.from_string("highest"), wide_t::highest);
+
+    // dense index from a negative min, looked up with values far outside of it
+    enum_table<compact_t> const compact = { { compact_t::a, "a" }, { compact_t::b, "b" }, { compact_t::c, "c" } };
+    EXPECT_EQ(compact.to_string(compact_t::a), "a");
+    EXPECT_EQ(compact.to_string(compact_t::c), "c");
+    EXPECT_EQ(compact.to_string(compact_t(0)), std::nullopt);
+    EXPECT_EQ(compact.to_string(compact_t(6)), std::nullopt);
+    EXPECT_EQ(compact.to_string(compact_t(INT64_MAX)), std::nullopt);
+    EXPECT_EQ(compact.to_string(compact_t(INT64_MIN)), std::nullopt);
+}
+
+struct memory_fixture_t
+{
+    vector<int> values;
+    string short_name;
+    string long_name;
+    map<string, int> index;
+    optional<string> note;
+
+    REFL_INNER(memory_fixture_t)
+        REFL_ENTRY(values)
+        REFL_ENTRY(short_name)
+        REFL_ENTRY(long_name)
+        REFL_ENTRY(index)
+        REFL_ENTRY(note)
+    REFL_END()
+};
+
+namespace
+{
+    memory_fixture_t make_memory_fixture(size_t n)
+    {
+        memory_fixture_t f;
+        f.values.reserve(10);
+        f.values.assign(n, 1);
+        f.short_name = "abc";
+        f.long_name.assign(100 + n, 'x');
+        for (size_t i = 0; i < n; ++i)
+            f.index["k" + to_string(i)] = int(i);
+        f.note = string(50, 'n');
+        return f;
+    }
+
+    size_t string_heap(string const &s)
+    {
+        return s.capacity() + 1;
+    }
+} // namespace
+
+TEST(memory_usage, paths_of_a_single_object)
+{
+    auto const f = make_memory_fixture(4);
+    auto const report = cora::memory_usage(f);
+    size_t const word = sizeof(void *);
+
+    auto const entry = [&report](char const *path)
+    {
+        auto const *e = report.find(path);
+        EXPECT_NE(e, nullptr) << path;
+        return e ? *e : cora::memory_usage_entry();
+    };
+
+    // vector slack: capacity 10, size 4
+    EXPECT_EQ(entry("values").count, 1u);
+    EXPECT_EQ(entry("values").shallow_bytes, sizeof(vector<int>));
+    EXPECT_EQ(entry("values").heap_bytes, 10 * sizeof(int));
+    EXPECT_EQ(entry("values").slack_bytes, 6 * sizeof(int));
+    EXPECT_EQ(entry("values[]").count, 4u);
+    EXPECT_EQ(entry("values[]").shallow_bytes, 4 * sizeof(int));
+
+    // the short string stays in the small string buffer, the long one holds its capacity and the terminator
+    EXPECT_EQ(entry("short_name").inline_strings, 1u);
+    EXPECT_EQ(entry("short_name").heap_bytes, 0u);
+    EXPECT_EQ(entry("long_name").inline_strings, 0u);
+    EXPECT_EQ(entry("long_name").heap_bytes, string_heap(f.long_name));
+    EXPECT_EQ(entry("long_name").slack_bytes, f.long_name.capacity() - f.long_name.size());
+
+    // map nodes: the value and the tree links and color
+    using node_value = map<string, int>::value_type;
+    EXPECT_EQ(entry("index").heap_bytes, 4 * (sizeof(node_value) + 4 * word));
+    EXPECT_EQ(entry("index").overhead_bytes, 4 * 4 * word);
+    EXPECT_EQ(entry("index[]").count, 4u);
+    EXPECT_EQ(entry("index[].first").shallow_bytes, 4 * sizeof(string));
+    EXPECT_EQ(entry("index[].first").inline_strings, 4u);
+    EXPECT_EQ(entry("index[].second").count, 4u);
+
+    // the optional adds its flag and padding, its value is accounted at the same path
+    EXPECT_EQ(entry("note").overhead_bytes, sizeof(optional<string>) - sizeof(string));
+    EXPECT_EQ(entry("note").heap_bytes, string_heap(*f.note));
+
+    auto const &root = report.root();
+    EXPECT_EQ(root.path, "");
+    EXPECT_EQ(root.shallow_bytes, sizeof(memory_fixture_t));
+    EXPECT_EQ(root.deep_bytes, entry("values").heap_bytes + entry("long_name").heap_bytes + entry("index").heap_bytes
+        + entry("note").heap_bytes);
+    EXPECT_EQ(report.total_bytes(), root.shallow_bytes + root.deep_bytes);
+
+    // every path comes after its parent
+    EXPECT_LT(report.find("index") - report.entries.data(), report.find("index[]") - report.entries.data());
+    EXPECT_LT(report.find("index[]") - report.entries.data(), report.find("index[].second") - report.entries.data());
+
+    ASSERT_EQ(report.top_heap(1).size(), 1u);
+    EXPECT_EQ(report.top_heap(1).front()->path, entry("index").heap_bytes > entry("long_name").heap_bytes ? "index" : "long_name");
+}
+
+TEST(memory_usage, aggregate_of_objects)
+{
+    vector<memory_fixture_t> objects;
+    for (size_t n : { 1, 2, 3 })
+        objects.push_back(make_memory_fixture(n));
+
+    auto const report = cora::memory_usage(objects.begin(), objects.end());
+
+    size_t total = 0;
+    size_t long_name_heap = 0;
+    for (auto const &obj : objects)
+    {
+        total += cora::memory_usage(obj).total_bytes();
+        long_name_heap += string_heap(obj.long_name);
+    }
+
+    EXPECT_EQ(report.root().count, 3u);
+    EXPECT_EQ(report.total_bytes(), total);
+    EXPECT_EQ(report.find("values")->count, 3u);
+    EXPECT_EQ(report.find("values[]")->count, 1u + 2u + 3u);
+    EXPECT_EQ(report.find("values")->slack_bytes, (9 + 8 + 7) * sizeof(int));
+    EXPECT_EQ(report.find("index[]")->count, 1u + 2u + 3u);
+    EXPECT_EQ(report.find("short_name")->inline_strings, 3u);
+    EXPECT_EQ(report.find("long_name")->heap_bytes, long_name_heap);
+
+    // no entry for the paths no object had
+    EXPECT_EQ(report.find("note.0"), nullptr);
+}
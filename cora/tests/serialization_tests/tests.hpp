@@ -0,0 +1,903 @@
+#include "cora/reflection/reflection.h"
+#include "cora/reflection/refl_operators.h"
+#include "cora/serialization/async_sink.h"
+#include "cora/serialization/binary_io.h"
+#include "cora/serialization/json_io.h"
+#include "cora/serialization/record_log.h"
+#include "cora/serialization/shm_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace cora;
+
+struct sink_record_t
+{
+    int producer = 0;
+    int seq = 0;
+
+    REFL_INNER(sink_record_t)
+        REFL_ENTRY(producer)
+        REFL_ENTRY(seq)
+    REFL_END()
+};
+
+namespace
+{
+    vector<sink_record_t> parse_lines(string const &text)
+    {
+        vector<sink_record_t> records;
+        istringstream s(text);
+        string line;
+        while (getline(s, line))
+        {
+            records.emplace_back();
+            json_io::string_to_data(line, records.back());
+        }
+        return records;
+    }
+
+    // small rings and blocks, so that producers wait and blocks are handed off all the time
+    async_sink_options small_sink_options()
+    {
+        async_sink_options options;
+        options.ring_capacity      = 8;
+        options.block_size         = 64;
+        options.max_pending_blocks = 2;
+        options.workers            = 2;
+        return options;
+    }
+
+    // pushes the next record of the same producer after each one, the ring it is called for is never empty
+    struct refilling_serializer
+    {
+        function<void(sink_record_t const &)> const *refill;
+
+        void operator()(string &out, sink_record_t const &obj)
+        {
+            json_line_serializer()(out, obj);
+            if (obj.producer == 0)
+                (*refill)(obj);
+        }
+    };
+
+    struct throwing_serializer
+    {
+        void operator()(string &out, sink_record_t const &obj)
+        {
+            // part of a line first, which must not reach the stream
+            if (obj.seq == 13)
+            {
+                out += "{\"producer\":";
+                throw runtime_error("unlucky record");
+            }
+            json_line_serializer()(out, obj);
+        }
+    };
+} // namespace
+
+TEST(async_sink, producer_order_is_kept)
+{
+    int const producers = 5;
+    int const per_producer = 2000;
+
+    stringstream out;
+    {
+        async_sink<sink_record_t> sink(out, json_line_serializer(), small_sink_options());
+
+        vector<thread> threads;
+        for (int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back([&sink, p, producer = sink.make_producer()]() mutable
+            {
+                for (int i = 0; i < per_producer; ++i)
+                    producer.push(sink_record_t{ p, i });
+            });
+        }
+
+        for (auto &t : threads)
+            t.join();
+    }
+
+    auto const records = parse_lines(out.str());
+    ASSERT_EQ(records.size(), size_t(producers * per_producer));
+
+    vector<int> next(producers, 0);
+    for (auto const &r : records)
+    {
+        ASSERT_GE(r.producer, 0);
+        ASSERT_LT(r.producer, producers);
+        EXPECT_EQ(r.seq, next[r.producer]++);
+    }
+}
+
+TEST(async_sink, flush_writes_everything_pushed)
+{
+    stringstream out;
+    async_sink<sink_record_t> sink(out, json_line_serializer(), small_sink_options());
+    auto producer = sink.make_producer();
+
+    for (int round = 1; round <= 3; ++round)
+    {
+        for (int i = 0; i < 100; ++i)
+            producer.push(sink_record_t{ 0, i });
+
+        sink.flush();
+        EXPECT_EQ(parse_lines(out.str()).size(), size_t(round * 100));
+    }
+
+    // nothing pushed in between
+    sink.flush();
+    EXPECT_EQ(parse_lines(out.str()).size(), 300u);
+}
+
+TEST(async_sink, destructor_drains)
+{
+    stringstream out;
+    {
+        async_sink_options options = small_sink_options();
+        options.idle_sleep = chrono::milliseconds(50);
+
+        async_sink<sink_record_t> sink(out, json_line_serializer(), options);
+        auto first = sink.make_producer();
+        auto second = sink.make_producer();
+        for (int i = 0; i < 500; ++i)
+        {
+            first.push(sink_record_t{ 0, i });
+            second.push(sink_record_t{ 1, i });
+        }
+    }
+
+    auto const records = parse_lines(out.str());
+    ASSERT_EQ(records.size(), 1000u);
+    EXPECT_EQ(records.back().seq, 499);
+}
+
+TEST(async_sink, serializer_exception_is_rethrown_by_flush)
+{
+    stringstream out;
+    async_sink<sink_record_t, throwing_serializer> sink(out, throwing_serializer(), small_sink_options());
+    auto producer = sink.make_producer();
+
+    for (int i = 0; i < 20; ++i)
+        producer.push(sink_record_t{ 0, i });
+
+    EXPECT_THROW(sink.flush(), runtime_error);
+
+    // reported once, the other records are written nevertheless
+    EXPECT_NO_THROW(sink.flush());
+    auto const records = parse_lines(out.str());
+    ASSERT_EQ(records.size(), 19u);
+    EXPECT_EQ(records[12].seq, 12);
+    EXPECT_EQ(records[13].seq, 14);
+}
+
+TEST(async_sink, flush_returns_under_load)
+{
+    stringstream out;
+    atomic<bool> stop{ false };
+    function<void(sink_record_t const &)> refill;
+    {
+        async_sink<sink_record_t, refilling_serializer> sink(out, refilling_serializer{ &refill }, small_sink_options());
+
+        // from now on the worker of the first producer never sees its ring empty
+        auto busy = sink.make_producer();
+        refill = [&stop, &busy](sink_record_t const &obj)
+        {
+            if (!stop)
+                busy.push(sink_record_t{ obj.producer, obj.seq + 1 });
+        };
+        busy.push(sink_record_t{ 0, 0 });
+
+        auto last = sink.make_producer();
+        for (int round = 0; round < 5; ++round)
+        {
+            last.push(sink_record_t{ 1, round });
+
+            auto flushed = async(launch::async, [&sink] { sink.flush(); });
+            bool const returned = flushed.wait_for(chrono::seconds(10)) == future_status::ready;
+            EXPECT_TRUE(returned) << round;
+            if (!returned)
+            {
+                stop = true;
+                break;
+            }
+        }
+        stop = true;
+    }
+
+    vector<int> next(2, 0);
+    for (auto const &r : parse_lines(out.str()))
+        EXPECT_EQ(r.seq, next[r.producer]++);
+    EXPECT_GT(next[0], 0);
+    EXPECT_EQ(next[1], 5);
+}
+
+TEST(async_sink, max_producers)
+{
+    stringstream out;
+    async_sink_options options;
+    options.max_producers = 2;
+
+    async_sink<sink_record_t> sink(out, json_line_serializer(), options);
+    auto first = sink.make_producer();
+    auto second = sink.make_producer();
+    EXPECT_THROW(sink.make_producer(), length_error);
+
+    // the producers made before keep working
+    first.push(sink_record_t{ 0, 0 });
+    second.push(sink_record_t{ 1, 0 });
+    sink.flush();
+    EXPECT_EQ(parse_lines(out.str()).size(), 2u);
+}
+
+struct tagged_t
+{
+    int id = 0;
+    string_view name;
+
+    REFL_INNER(tagged_t)
+        REFL_ENTRY(id)
+        REFL_ENTRY(name)
+    REFL_END()
+};
+
+struct padded_t
+{
+    char c = 0;
+    double d = 0;
+
+    ENABLE_REFL_EQ(padded_t)
+
+    REFL_INNER(padded_t)
+        REFL_ENTRY(c)
+        REFL_ENTRY(d)
+    REFL_END()
+};
+
+struct packed_t
+{
+    int32_t a = 0;
+    int32_t b = 0;
+    double d = 0;
+
+    ENABLE_REFL_EQ(packed_t)
+
+    REFL_INNER(packed_t)
+        REFL_ENTRY(a)
+        REFL_ENTRY(b)
+        REFL_ENTRY(d)
+    REFL_END()
+};
+
+struct packed_nested_t
+{
+    packed_t p;
+    array<int16_t, 4> arr{};
+
+    ENABLE_REFL_EQ(packed_nested_t)
+
+    REFL_INNER(packed_nested_t)
+        REFL_ENTRY(p)
+        REFL_ENTRY(arr)
+    REFL_END()
+};
+
+struct partly_reflected_t
+{
+    int a = 0;
+    int hidden = 0;
+
+    REFL_INNER(partly_reflected_t)
+        REFL_ENTRY(a)
+    REFL_END()
+};
+
+struct unreflected_t
+{
+    int a;
+    int b;
+};
+
+struct unreflected_padded_t
+{
+    char c;
+    int i;
+};
+
+// the same size as its referent, but holds its address
+struct reference_t
+{
+    explicit reference_t(int64_t &r)
+        : r(r)
+    {
+    }
+
+    int64_t &r;
+
+    REFL_INNER(reference_t)
+        REFL_ENTRY(r)
+    REFL_END()
+};
+
+enum class level_t : uint8_t { low, high };
+
+static_assert(binary_io::is_memcpy_v<int>);
+static_assert(binary_io::is_memcpy_v<level_t>);
+static_assert(binary_io::is_memcpy_v<packed_t>);
+static_assert(binary_io::is_memcpy_v<packed_nested_t>);
+static_assert(binary_io::is_memcpy_v<packed_t[3]>);
+static_assert(binary_io::is_memcpy_v<unreflected_t>);
+static_assert(!binary_io::is_memcpy_v<int *>);
+static_assert(!binary_io::is_memcpy_v<string_view>);
+static_assert(!binary_io::is_memcpy_v<tagged_t>);
+static_assert(!binary_io::is_memcpy_v<padded_t>);
+static_assert(!binary_io::is_memcpy_v<array<padded_t, 2>>);
+static_assert(!binary_io::is_memcpy_v<partly_reflected_t>);
+static_assert(!binary_io::is_memcpy_v<unreflected_padded_t>);
+static_assert(!binary_io::is_memcpy_v<std::monostate>);
+static_assert(!binary_io::is_memcpy_v<reference_t>);
+static_assert(!binary_io::is_memcpy_v<array<reference_t, 2>>);
+
+struct binary_record_t
+{
+    string name;
+    vector<padded_t> padded;
+    vector<packed_t> packed;
+    optional<packed_nested_t> nested;
+    map<string, vector<int>> groups;
+    variant<int, string> tag;
+    array<padded_t, 2> pair_of_padded{};
+    vector<bool> flags;
+    level_t level = level_t::low;
+
+    ENABLE_REFL_EQ(binary_record_t)
+
+    REFL_INNER(binary_record_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(padded)
+        REFL_ENTRY(packed)
+        REFL_ENTRY(nested)
+        REFL_ENTRY(groups)
+        REFL_ENTRY(tag)
+        REFL_ENTRY(pair_of_padded)
+        REFL_ENTRY(flags)
+        REFL_ENTRY(level)
+    REFL_END()
+};
+
+namespace
+{
+    binary_record_t make_binary_record()
+    {
+        binary_record_t r;
+        r.name = "record";
+        r.padded = { { 'a', 1.5 }, { 'b', -2 } };
+        r.packed = { { 1, 2, 3.5 }, { -1, -2, -3.5 } };
+        r.nested = packed_nested_t{ { 7, 8, 9 }, { 1, 2, 3, 4 } };
+        r.groups = { { "odd", { 1, 3 } }, { "none", {} } };
+        r.tag = string("tag");
+        r.pair_of_padded = { padded_t{ 'x', 0.25 }, padded_t{ 'y', 0.5 } };
+        r.flags = { true, false, true };
+        r.level = level_t::high;
+        return r;
+    }
+
+    // distinct per process, so that concurrent test runs do not share segments
+    string shm_name(char const *test)
+    {
+        return "/cora_" + string(test) + "_" + to_string(::getpid());
+    }
+} // namespace
+
+TEST(binary_io, roundtrip)
+{
+    auto const record = make_binary_record();
+    string const data = binary_io::data_to_string(record);
+    EXPECT_EQ(data.size(), binary_io::encoded_size(record));
+
+    binary_record_t decoded;
+    binary_io::string_to_data(data, decoded);
+    EXPECT_TRUE(decoded == record);
+
+    // decoding into a populated object replaces everything
+    binary_io::string_to_data(binary_io::data_to_string(binary_record_t()), decoded);
+    EXPECT_TRUE(decoded == binary_record_t());
+}
+
+TEST(binary_io, truncated_and_trailing_data)
+{
+    string const data = binary_io::data_to_string(make_binary_record());
+
+    for (size_t size = 0; size < data.size(); ++size)
+    {
+        binary_record_t decoded;
+        EXPECT_THROW(binary_io::string_to_data(string_view(data.data(), size), decoded), binary_io::decode_error) << size;
+    }
+
+    binary_record_t decoded;
+    EXPECT_THROW(binary_io::string_to_data(data + '\0', decoded), binary_io::decode_error);
+}
+
+TEST(binary_io, reference_members_are_written_by_value)
+{
+    int64_t value = 42;
+    string const data = binary_io::data_to_string(reference_t(value));
+    ASSERT_EQ(data.size(), sizeof(int64_t));
+
+    int64_t decoded_value = 0;
+    reference_t decoded(decoded_value);
+    binary_io::string_to_data(data, decoded);
+    EXPECT_EQ(decoded_value, 42);
+    EXPECT_EQ(&decoded.r, &decoded_value);
+}
+
+TEST(binary_io, padding_is_not_written)
+{
+    // the same values over different garbage
+    alignas(padded_t) unsigned char first_storage[sizeof(padded_t)];
+    alignas(padded_t) unsigned char second_storage[sizeof(padded_t)];
+    memset(first_storage, 0xab, sizeof(first_storage));
+    memset(second_storage, 0xcd, sizeof(second_storage));
+
+    auto *first = ::new (first_storage) padded_t;
+    auto *second = ::new (second_storage) padded_t;
+    first->c = second->c = 'p';
+    first->d = second->d = 3.25;
+
+    string const encoded = binary_io::data_to_string(*first);
+    EXPECT_EQ(encoded.size(), sizeof(char) + sizeof(double));
+    EXPECT_EQ(encoded, binary_io::data_to_string(*second));
+
+    // fields of a view type are encoded as strings, not as a pointer
+    EXPECT_EQ(binary_io::data_to_string(tagged_t{ 1, "name" }).size(), sizeof(int) + sizeof(binary_io::size_type) + 4);
+}
+
+TEST(shm_ring, publish_and_receive)
+{
+    string const name = shm_name("publish_and_receive");
+    shm_publisher<binary_record_t> publisher(name, 8);
+    shm_subscriber<binary_record_t> subscriber(name);
+
+    binary_record_t msg;
+    EXPECT_FALSE(subscriber.try_receive(msg));
+
+    auto record = make_binary_record();
+    for (int i = 0; i < 3; ++i)
+    {
+        record.packed[0].a = i;
+        EXPECT_EQ(publisher.publish(record), uint64_t(i + 1));
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_TRUE(subscriber.receive(msg, chrono::seconds(1)));
+        record.packed[0].a = i;
+        EXPECT_TRUE(msg == record);
+    }
+    EXPECT_FALSE(subscriber.try_receive(msg));
+    EXPECT_EQ(subscriber.lost(), 0u);
+}
+
+TEST(shm_ring, memcpy_messages_and_lapping)
+{
+    string const name = shm_name("memcpy_messages");
+    shm_publisher<packed_t> publisher(name, 4);
+    shm_subscriber<packed_t> subscriber(name);
+
+    // the ring holds 4, the oldest of them is the next to be overwritten
+    for (int i = 1; i <= 10; ++i)
+        publisher.publish(packed_t{ i, -i, i * 0.5 });
+
+    packed_t msg;
+    vector<int> received;
+    while (subscriber.try_receive(msg))
+    {
+        EXPECT_EQ(msg.b, -msg.a);
+        received.push_back(msg.a);
+    }
+
+    EXPECT_EQ(received, vector<int>({ 8, 9, 10 }));
+    EXPECT_EQ(subscriber.lost(), 7u);
+}
+
+TEST(shm_ring, subscriber_checks_the_segment)
+{
+    string const name = shm_name("checks_the_segment");
+    EXPECT_THROW(shm_subscriber<packed_t> subscriber(name), system_error);
+
+    shm_publisher<packed_t> publisher(name, 4);
+    EXPECT_THROW(shm_subscriber<packed_nested_t> subscriber(name), runtime_error);
+    EXPECT_NO_THROW(shm_subscriber<packed_t> subscriber(name));
+
+    // too big for a slot
+    shm_publisher<binary_record_t> small(shm_name("small_slots"), 2, 16);
+    EXPECT_THROW(small.publish(make_binary_record()), length_error);
+}
+
+struct log_frame_t
+{
+    double time = 0;
+    int id = 0;
+    string name;
+    vector<float> values;
+
+    ENABLE_REFL_EQ(log_frame_t)
+
+    REFL_INNER(log_frame_t)
+        REFL_ENTRY(time)
+        REFL_ENTRY(id)
+        REFL_ENTRY(name)
+        REFL_ENTRY(values)
+    REFL_END()
+};
+
+namespace
+{
+    // times grow with the ids, with a jump every 7th frame so that the blocks key ranges overlap
+    vector<log_frame_t> make_log_frames(int count)
+    {
+        vector<log_frame_t> frames;
+        for (int i = 0; i < count; ++i)
+        {
+            log_frame_t f;
+            f.time = i * 0.01 + (i % 7 == 0 ? 1000 : 0);
+            f.id = i;
+            f.name = "unit_" + to_string(i % 50);
+            f.values.assign(size_t(i % 9), float(i % 13));
+            frames.push_back(f);
+        }
+        return frames;
+    }
+
+    string write_log(vector<log_frame_t> const &frames, record_log_codec codec, string const &prefix = string())
+    {
+        record_log_options options;
+        options.codec = codec;
+        options.block_records = 500;
+
+        stringstream s;
+        s << prefix;
+        record_log_writer<log_frame_t> writer(s, &log_frame_t::time, options);
+        for (auto const &f : frames)
+            writer.write(f);
+        writer.close();
+        return s.str();
+    }
+
+    // the log must be rejected or decode to anything, but never read out of bounds
+    void read_everything(string const &log)
+    {
+        stringstream s(log);
+        record_log_reader<log_frame_t> reader(s);
+        reader.read_range(0, reader.size(), 2);
+        if (reader.size() != 0)
+            reader.read(reader.size() - 1);
+    }
+
+    string footer_error(string const &log)
+    {
+        try
+        {
+            read_everything(log);
+        }
+        catch (record_log_error const &e)
+        {
+            return e.what();
+        }
+        return string();
+    }
+} // namespace
+
+TEST(record_log, lz_roundtrip)
+{
+    mt19937 rng(1);
+    for (int i = 0; i < 200; ++i)
+    {
+        size_t const size = rng() % 70000;
+        unsigned const alphabet = 1 + rng() % 256;
+
+        string src(size, '\0');
+        for (auto &c : src)
+            c = char(rng() % alphabet);
+
+        // long and overlapping matches
+        if (i % 3 == 0)
+        {
+            for (size_t j = 100; j < size; ++j)
+            {
+                if (rng() % 4 != 0)
+                    src[j] = src[j - 1 - rng() % 90];
+            }
+        }
+
+        string compressed;
+        detail::lz_compress(src.data(), src.size(), compressed);
+
+        string decompressed(size, '\0');
+        detail::lz_decompress(compressed.data(), compressed.size(), &decompressed[0], decompressed.size());
+        ASSERT_EQ(decompressed, src) << i;
+    }
+
+    string const zeros(100000, '\0');
+    string compressed;
+    detail::lz_compress(zeros.data(), zeros.size(), compressed);
+    EXPECT_LT(compressed.size(), zeros.size() / 100);
+}
+
+TEST(record_log, lz_corruption)
+{
+    mt19937 rng(2);
+    string src(20000, '\0');
+    for (size_t j = 0; j < src.size(); ++j)
+        src[j] = j < 64 || rng() % 3 == 0 ? char(rng()) : src[j - 1 - rng() % 60];
+
+    string compressed;
+    detail::lz_compress(src.data(), src.size(), compressed);
+
+    string out(src.size(), '\0');
+    for (int i = 0; i < 500; ++i)
+    {
+        string bad = compressed;
+        bad[rng() % bad.size()] ^= char(1 + rng() % 255);
+        if (i % 2)
+            bad.resize(rng() % bad.size());
+
+        try
+        {
+            detail::lz_decompress(bad.data(), bad.size(), &out[0], out.size());
+        }
+        catch (record_log_error const &)
+        {
+        }
+    }
+
+    // a shorter or longer output is an error
+    EXPECT_THROW(detail::lz_decompress(compressed.data(), compressed.size(), &out[0], out.size() - 1), record_log_error);
+    string longer(src.size() + 1, '\0');
+    EXPECT_THROW(detail::lz_decompress(compressed.data(), compressed.size(), &longer[0], longer.size()), record_log_error);
+}
+
+TEST(record_log, read)
+{
+    auto const frames = make_log_frames(5000);
+    for (auto codec : { record_log_codec::lz, record_log_codec::none })
+    {
+        // the log does not have to start at the beginning of the stream
+        stringstream s(write_log(frames, codec, "prefix"));
+        s.seekg(6);
+        record_log_reader<log_frame_t> reader(s);
+
+        ASSERT_EQ(reader.size(), frames.size());
+        EXPECT_TRUE(reader.has_key());
+        EXPECT_EQ(reader.blocks().size(), 10u);
+
+        mt19937 rng(3);
+        for (int i = 0; i < 500; ++i)
+        {
+            size_t const n = rng() % frames.size();
+            ASSERT_TRUE(reader.read(n) == frames[n]) << n;
+        }
+        EXPECT_TRUE(reader.read(frames.size() - 1) == frames.back());
+        EXPECT_THROW(reader.read(frames.size()), out_of_range);
+    }
+}
+
+TEST(record_log, read_range)
+{
+    auto const frames = make_log_frames(5000);
+    stringstream s(write_log(frames, record_log_codec::lz));
+    record_log_reader<log_frame_t> reader(s);
+
+    auto const range = reader.read_range(1234, 3456, 4);
+    EXPECT_TRUE(range == vector<log_frame_t>(frames.begin() + 1234, frames.begin() + 3456));
+
+    // a block boundary, a single record and the end clamped
+    EXPECT_TRUE(reader.read_range(499, 501) == vector<log_frame_t>(frames.begin() + 499, frames.begin() + 501));
+    EXPECT_TRUE(reader.read_range(42, 43, 1) == vector<log_frame_t>(1, frames[42]));
+    EXPECT_TRUE(reader.read_range(0, uint64_t(1) << 40) == frames);
+    EXPECT_TRUE(reader.read_range(100, 100).empty());
+    EXPECT_TRUE(reader.read_range(6000, 7000).empty());
+}
+
+TEST(record_log, read_key_range)
+{
+    auto const frames = make_log_frames(5000);
+    stringstream s(write_log(frames, record_log_codec::lz));
+    record_log_reader<log_frame_t> reader(s);
+
+    auto const expected = [&frames](double lo, double hi)
+    {
+        vector<log_frame_t> result;
+        for (auto const &f : frames)
+        {
+            if (f.time >= lo && f.time <= hi)
+                result.push_back(f);
+        }
+        return result;
+    };
+
+    EXPECT_TRUE(reader.read_key_range(&log_frame_t::time, 10.0, 20.5, 3) == expected(10.0, 20.5));
+
+    // bounds of another type are converted to the key type, a callable is a key as well
+    auto const jumped = reader.read_key_range([](log_frame_t const &f) { return f.time; }, 1000, 1010);
+    EXPECT_FALSE(jumped.empty());
+    EXPECT_TRUE(jumped == expected(1000, 1010));
+
+    EXPECT_TRUE(reader.read_key_range(&log_frame_t::time, 500.0, 600.0).empty());
+    EXPECT_TRUE(reader.read_key_range(&log_frame_t::time, -1e9, 1e9) == frames);
+}
+
+// constructed in place by variant::emplace, so a throwing constructor leaves the variant valueless
+struct fragile_t
+{
+    fragile_t() = default;
+    fragile_t(fragile_t const &) = default;
+    fragile_t &operator=(fragile_t const &) = default;
+
+    fragile_t(fragile_t &&other)
+        : text(std::move(other.text))
+    {
+    }
+
+    explicit fragile_t(bool fail)
+    {
+        if (fail)
+            throw runtime_error("fragile");
+    }
+
+    string text;
+
+    REFL_INNER(fragile_t)
+        REFL_ENTRY(text)
+    REFL_END()
+};
+
+struct log_variant_t
+{
+    string name;
+    variant<int, fragile_t> value;
+
+    REFL_INNER(log_variant_t)
+        REFL_ENTRY(name)
+        REFL_ENTRY(value)
+    REFL_END()
+};
+
+TEST(record_log, writer_is_usable_after_a_failed_write)
+{
+    stringstream s;
+    {
+        record_log_writer<log_variant_t> writer(s);
+        EXPECT_EQ(writer.write({ "first", 1 }), 0u);
+
+        // the name is encoded before the variant fails
+        log_variant_t broken{ "broken", 0 };
+        EXPECT_THROW(broken.value.emplace<fragile_t>(true), runtime_error);
+        ASSERT_TRUE(broken.value.valueless_by_exception());
+        EXPECT_THROW(writer.write(broken), bad_variant_access);
+
+        log_variant_t second{ "second", fragile_t(false) };
+        get<fragile_t>(second.value).text = "two";
+        EXPECT_EQ(writer.write(second), 1u);
+        EXPECT_EQ(writer.size(), 2u);
+        writer.close();
+    }
+
+    record_log_reader<log_variant_t> reader(s);
+    ASSERT_EQ(reader.size(), 2u);
+    EXPECT_EQ(reader.read(0).name, "first");
+    EXPECT_EQ(get<int>(reader.read(0).value), 1);
+    EXPECT_EQ(reader.read(1).name, "second");
+    EXPECT_EQ(get<fragile_t>(reader.read(1).value).text, "two");
+
+    // a key that fails leaves neither the record nor its key in the block
+    auto const frames = make_log_frames(10);
+    stringstream keyed;
+    {
+        record_log_writer<log_frame_t> writer(keyed, [](log_frame_t const &f)
+        {
+            if (f.id < 0)
+                throw invalid_argument("no key");
+            return f.time;
+        });
+
+        log_frame_t bad = frames[3];
+        bad.id = -1;
+        bad.time = -100;
+        for (auto const &f : frames)
+        {
+            writer.write(f);
+            EXPECT_THROW(writer.write(bad), invalid_argument);
+        }
+        writer.close();
+    }
+
+    record_log_reader<log_frame_t> keyed_reader(keyed);
+    EXPECT_TRUE(keyed_reader.read_range(0, 100) == frames);
+    auto const by_time = [](log_frame_t const &a, log_frame_t const &b) { return a.time < b.time; };
+    EXPECT_EQ(keyed_reader.blocks().front().min_key, make_sort_key(min_element(frames.begin(), frames.end(), by_time)->time));
+}
+
+TEST(record_log, empty_log)
+{
+    stringstream s;
+    {
+        record_log_writer<log_frame_t> writer(s);
+    }
+
+    record_log_reader<log_frame_t> reader(s);
+    EXPECT_EQ(reader.size(), 0u);
+    EXPECT_FALSE(reader.has_key());
+    EXPECT_TRUE(reader.blocks().empty());
+    EXPECT_TRUE(reader.read_range(0, 10).empty());
+    EXPECT_THROW(reader.read(0), out_of_range);
+    EXPECT_THROW(reader.read_key_range(&log_frame_t::time, 0.0, 1.0), logic_error);
+
+    // another record type
+    stringstream other(s.str());
+    EXPECT_THROW(record_log_reader<sink_record_t> wrong(other), record_log_error);
+
+    stringstream nothing;
+    EXPECT_THROW(record_log_reader<log_frame_t> none(nothing), record_log_error);
+}
+
+TEST(record_log, truncated_log)
+{
+    string const log = write_log(make_log_frames(1200), record_log_codec::lz);
+
+    // without the footer the log is unreadable, whatever is left of it
+    for (size_t size = 0; size < log.size(); size += 1 + size / 16)
+        EXPECT_THROW(read_everything(log.substr(0, size)), record_log_error) << size;
+    EXPECT_THROW(read_everything(log.substr(0, log.size() - 1)), record_log_error);
+}
+
+TEST(record_log, corrupt_log)
+{
+    string const log = write_log(make_log_frames(1200), record_log_codec::lz);
+
+    mt19937 rng(4);
+    for (int i = 0; i < 300; ++i)
+    {
+        string bad = log;
+        bad[rng() % bad.size()] ^= char(1 + rng() % 255);
+        try
+        {
+            read_everything(bad);
+        }
+        catch (exception const &)
+        {
+        }
+    }
+
+    // index offsets past the footer must not wrap around in the bounds checks
+    detail::record_log_footer footer;
+    binary_io::string_to_data(string_view(log).substr(log.size() - sizeof(footer)), footer);
+    for (uint64_t offset : { uint64_t(log.size()), uint64_t(log.size()) - sizeof(footer) + 1, ~uint64_t(0) })
+    {
+        auto bad_footer = footer;
+        bad_footer.index_offset = offset;
+        string const bad = log.substr(0, log.size() - sizeof(footer)) + binary_io::data_to_string(bad_footer);
+        EXPECT_EQ(footer_error(bad), "record_log_reader: corrupt footer") << offset;
+    }
+}